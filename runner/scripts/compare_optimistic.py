@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+"""
+Compare optimistic scheduling (validate at completion, retry aborts) against a pessimistic
+policy across contention levels. Run from the runner directory after building it for a
+software board, e.g.
+
+    ./scripts/compare_optimistic.py --n_objs 100 1000 100000 --write_probability 0.5 0.1
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+def run(cmd, env):
+    result = subprocess.run(cmd, env=env, capture_output=True, text=True)
+    return result.stdout + result.stderr
+
+def measure(args, env, workload, log, policy):
+    out = run(['./bin/main', '--input', workload, '--log', log, '--policy', policy,
+               '--puppets', str(args.puppets), '--clients', str(args.clients),
+               '--work-us', str(args.work_us), '--sample-shift', str(args.sample_shift),
+               '--timeout', str(args.timeout)] + args.extra, env)
+    aborts = re.search(r'aborted (\d+) attempts \(([\d.]+)% abort rate\)', out)
+    abort_rate = float(aborts.group(2)) if aborts else 0.0
+
+    out = run(['./bin/analyze', workload, log, str(args.puppets), str(args.work_us)], env)
+    throughput = re.search(r'Throughput tx/s: ([\d.]+) \(raw\)', out)
+    conflicts = 'No conflicting pairs' not in out
+    if not throughput:
+        sys.exit(f'{policy}: no throughput in analyze output:\n{out}')
+    return float(throughput.group(1)), abort_rate, conflicts
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare optimistic and pessimistic scheduling')
+    parser.add_argument('--n_objs', type=int, nargs='+', default=[100, 1000, 10000, 100000],
+                        help='Object space sizes, from high to low contention')
+    parser.add_argument('--write_probability', type=float, nargs='+', default=[0.5])
+    parser.add_argument('--n_txns', type=int, default=20000)
+    parser.add_argument('--max_objs_per_txn', type=int, default=4)
+    parser.add_argument('--pessimistic', default='lookahead', help='Policy to compare against')
+    parser.add_argument('--puppets', type=int, default=4)
+    parser.add_argument('--clients', type=int, default=1)
+    parser.add_argument('--work-us', dest='work_us', type=int, default=0)
+    parser.add_argument('--sample-shift', dest='sample_shift', type=int, default=2,
+                        help='Log 1 in 2^S txns, leaving the log room for retries')
+    parser.add_argument('--timeout', type=int, default=60)
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('extra', nargs='*', help='Further options for the runner, after --')
+    args = parser.parse_args()
+
+    board = os.environ.get('BOARD')
+    if os.path.exists('bin/board.txt'):
+        with open('bin/board.txt') as f:
+            board = f.read().strip()
+    if not board:
+        sys.exit('error: BOARD must be defined to run this')
+    env = dict(os.environ)
+    env['LD_LIBRARY_PATH'] = f'{os.getcwd()}/deps/wrapper/output/{board}/:' + env.get('LD_LIBRARY_PATH', '')
+
+    print(f'{"Objects":>8} {"Write p":>8} {args.pessimistic + " tx/s":>16} {"optimistic tx/s":>16} {"Abort rate":>11} {"Speedup":>8}')
+    with tempfile.TemporaryDirectory() as tmp:
+        workload = os.path.join(tmp, 'transactions.csv')
+        log = os.path.join(tmp, 'log.bin')
+        for write_prob in args.write_probability:
+            for n_objs in args.n_objs:
+                subprocess.run([sys.executable, os.path.join(os.path.dirname(__file__), 'generate.py'),
+                                '--output', workload, '--n_txns', str(args.n_txns), '--n_objs', str(n_objs),
+                                '--max_objs_per_txn', str(args.max_objs_per_txn),
+                                '--write_probability', str(write_prob), '--seed', str(args.seed)],
+                               check=True, stdout=subprocess.DEVNULL)
+                pess, _, pess_bad = measure(args, env, workload, log, args.pessimistic)
+                opt, abort_rate, opt_bad = measure(args, env, workload, log, 'optimistic')
+                flag = ' (conflicts!)' if pess_bad or opt_bad else ''
+                print(f'{n_objs:>8} {write_prob:>8.2f} {pess:>16.0f} {opt:>16.0f} {abort_rate:>10.2f}% {opt / pess:>7.2f}x{flag}')
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""
+Measure how the throughput the software scheduler admits scales with the number of scheduler
+shards, on a uniform and on skewed workloads. Run from the runner directory after building it
+for a software board, e.g.
+
+    ./scripts/compare_shards.py --shards 1 2 4 8 --zipf 0 0.8 1.2 -- --wait sleep
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+def run(cmd, env):
+    result = subprocess.run(cmd, env=env, capture_output=True, text=True)
+    return result.stdout + result.stderr
+
+def measure(args, env, workload, log, shards):
+    out = run(['./bin/main', '--input', workload, '--log', log, '--shards', str(shards),
+               '--puppets', str(args.puppets), '--clients', str(args.clients),
+               '--work-us', str(args.work_us), '--timeout', str(args.timeout)] + args.extra, env)
+    cross = re.search(r'\(([\d.]+)% cross-shard\)', out)
+    cross_rate = float(cross.group(1)) if cross else 0.0
+
+    out = run(['./bin/analyze', workload, log, str(args.puppets), str(args.work_us)], env)
+    throughput = re.search(r'Throughput tx/s: ([\d.]+) \(raw\)', out)
+    conflicts = 'No conflicting pairs' not in out
+    if not throughput:
+        sys.exit(f'{shards} shards: no throughput in analyze output:\n{out}')
+    return float(throughput.group(1)), cross_rate, conflicts
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare sharded scheduler configurations')
+    parser.add_argument('--shards', type=int, nargs='+', default=[1, 2, 4])
+    parser.add_argument('--zipf', type=float, nargs='+', default=[0.0, 1.0],
+                        help='Zipf exponents of object popularity, 0 for uniform')
+    parser.add_argument('--n_objs', type=int, default=100000)
+    parser.add_argument('--write_probability', type=float, default=0.5)
+    parser.add_argument('--n_txns', type=int, default=100000)
+    parser.add_argument('--max_objs_per_txn', type=int, default=4)
+    parser.add_argument('--puppets', type=int, default=8, help='At least as many as the largest shard count')
+    parser.add_argument('--clients', type=int, default=2)
+    parser.add_argument('--work-us', dest='work_us', type=int, default=0)
+    parser.add_argument('--timeout', type=int, default=60)
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('extra', nargs='*', help='Further options for the runner, after --')
+    args = parser.parse_args()
+    if max(args.shards) > args.puppets:
+        sys.exit('error: every shard needs at least one puppet')
+
+    board = os.environ.get('BOARD')
+    if os.path.exists('bin/board.txt'):
+        with open('bin/board.txt') as f:
+            board = f.read().strip()
+    if not board:
+        sys.exit('error: BOARD must be defined to run this')
+    env = dict(os.environ)
+    env['LD_LIBRARY_PATH'] = f'{os.getcwd()}/deps/wrapper/output/{board}/:' + env.get('LD_LIBRARY_PATH', '')
+
+    print(f'{"Zipf":>6} {"Shards":>7} {"tx/s":>12} {"Cross-shard":>12} {"Speedup":>8}')
+    with tempfile.TemporaryDirectory() as tmp:
+        workload = os.path.join(tmp, 'transactions.csv')
+        log = os.path.join(tmp, 'log.bin')
+        for zipf in args.zipf:
+            subprocess.run([sys.executable, os.path.join(os.path.dirname(__file__), 'generate.py'),
+                            '--output', workload, '--n_txns', str(args.n_txns), '--n_objs', str(args.n_objs),
+                            '--max_objs_per_txn', str(args.max_objs_per_txn),
+                            '--write_probability', str(args.write_probability), '--seed', str(args.seed),
+                            '--zipf', str(zipf)],
+                           check=True, stdout=subprocess.DEVNULL)
+            base = None
+            for shards in args.shards:
+                tput, cross_rate, bad = measure(args, env, workload, log, shards)
+                base = base or tput
+                flag = ' (conflicts!)' if bad else ''
+                print(f'{zipf:>6.2f} {shards:>7} {tput:>12.0f} {cross_rate:>11.2f}% {tput / base:>7.2f}x{flag}')
+
+if __name__ == '__main__':
+    main()
@@ -2,11 +2,19 @@
 
 import random
 import argparse
+import itertools
 
-def generate_transactions(n_txns, n_objs, max_objs_per_txn, write_prob, seed=None):
+def generate_transactions(n_txns, n_objs, max_objs_per_txn, write_prob, seed=None, zipf=0.0):
     if seed is not None:
         random.seed(seed)
 
+    # Object i is picked with probability proportional to 1/(i+1)^zipf, uniformly if zipf is 0
+    if zipf > 0:
+        cum_weights = list(itertools.accumulate((i + 1) ** -zipf for i in range(n_objs)))
+        pick = lambda: random.choices(range(n_objs), cum_weights=cum_weights)[0]
+    else:
+        pick = lambda: random.randint(0, n_objs-1)
+
     transactions = []
 
     for txn_id in range(n_txns):
@@ -18,9 +26,9 @@ def generate_transactions(n_txns, n_objs, max_objs_per_txn, write_prob, seed=Non
         cnt_write = 0
         cnt_read = 0
         for _ in range(n_accesses):
-            objid = random.randint(0, n_objs-1)
+            objid = pick()
             while objid in used_objs:
-                objid = random.randint(0, n_objs-1)
+                objid = pick()
             used_objs.add(objid)
 
             writeflag = 1 if random.random() < write_prob else 0
@@ -44,6 +52,7 @@ def main():
     parser.add_argument('--max_objs_per_txn', type=int, default=4, help='Max number of objects per txn')
     parser.add_argument('--write_probability', type=float, default=0.5, help='Probability of a write (0-1)')
     parser.add_argument('--seed', type=int, default=None, help='Random seed (optional)')
+    parser.add_argument('--zipf', type=float, default=0.0, help='Zipf exponent of object popularity, 0 for uniform')
     args = parser.parse_args()
 
     txns = generate_transactions(
@@ -51,7 +60,8 @@ def main():
         n_objs=args.n_objs,
         max_objs_per_txn=args.max_objs_per_txn,
         write_prob=args.write_probability,
-        seed=args.seed
+        seed=args.seed,
+        zipf=args.zipf
     )
 
     with open(args.output, 'w') as f:
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""
+Regression run for work stealing with small per-puppet active depths, where a steal used to let
+the scheduler dispatch more transactions than its active set holds. Runs every combination
+several times and fails on any crash, timeout or conflicting schedule. Run from the runner
+directory after building it for a software board, e.g.
+
+    ./scripts/stress_stealing.py --repeat 10
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+def run(cmd, env, timeout):
+    try:
+        result = subprocess.run(cmd, env=env, capture_output=True, text=True, timeout=timeout)
+    except subprocess.TimeoutExpired:
+        return None, 'timed out'
+    return result.returncode, result.stdout + result.stderr
+
+def main():
+    parser = argparse.ArgumentParser(description='Stress work stealing at small active depths')
+    parser.add_argument('--depths', type=int, nargs='+', default=[1, 2, 4])
+    parser.add_argument('--policies', nargs='+', default=['exact', 'lookahead', 'optimistic'])
+    parser.add_argument('--waits', nargs='+', default=['spin', 'sleep'])
+    parser.add_argument('--shards', type=int, nargs='+', default=[1, 2])
+    parser.add_argument('--repeat', type=int, default=3)
+    parser.add_argument('--n_objs', type=int, default=2000)
+    parser.add_argument('--n_txns', type=int, default=4000)
+    parser.add_argument('--puppets', type=int, default=4)
+    parser.add_argument('--clients', type=int, default=2)
+    parser.add_argument('--timeout', type=int, default=60)
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+
+    board = os.environ.get('BOARD')
+    if os.path.exists('bin/board.txt'):
+        with open('bin/board.txt') as f:
+            board = f.read().strip()
+    if not board:
+        sys.exit('error: BOARD must be defined to run this')
+    env = dict(os.environ)
+    env['LD_LIBRARY_PATH'] = f'{os.getcwd()}/deps/wrapper/output/{board}/:' + env.get('LD_LIBRARY_PATH', '')
+
+    failures = 0
+    with tempfile.TemporaryDirectory() as tmp:
+        workload = os.path.join(tmp, 'transactions.csv')
+        log = os.path.join(tmp, 'log.bin')
+        subprocess.run([sys.executable, os.path.join(os.path.dirname(__file__), 'generate.py'),
+                        '--output', workload, '--n_txns', str(args.n_txns), '--n_objs', str(args.n_objs),
+                        '--seed', str(args.seed)],
+                       check=True, stdout=subprocess.DEVNULL)
+        for depth in args.depths:
+            for policy in args.policies:
+                for wait in args.waits:
+                    for shards in args.shards:
+                        # Validating policies cannot be sharded
+                        if shards > 1 and policy == 'optimistic':
+                            continue
+                        name = f'depth {depth}, {policy}, {wait}, {shards} shard(s)'
+                        for i in range(args.repeat):
+                            code, out = run(['./bin/main', '--input', workload, '--log', log, '--steal',
+                                             '--active-depth', str(depth), '--policy', policy, '--wait', wait,
+                                             '--shards', str(shards), '--puppets', str(args.puppets),
+                                             '--clients', str(args.clients), '--timeout', str(args.timeout)],
+                                            env, args.timeout + 30)
+                            error = None
+                            if code != 0 or 'Assertion failed' in out or 'Terminated' in out:
+                                error = out.strip().splitlines()[-1] if out.strip() else f'exit code {code}'
+                            else:
+                                code, out = run(['./bin/analyze', workload, log, str(args.puppets), '0'], env, args.timeout)
+                                if 'No conflicting pairs' not in out:
+                                    error = 'conflicting schedule'
+                            if error:
+                                failures += 1
+                                print(f'{name}, run {i}: FAILED: {error}')
+                                break
+                        else:
+                            print(f'{name}: ok')
+    if failures:
+        sys.exit(f'{failures} configuration(s) failed')
+
+if __name__ == '__main__':
+    main()
@@ -146,19 +146,25 @@ int main(int argc, char *argv[])
   timeline_t *tl = (timeline_t *) calloc(wl->num_txns, sizeof(timeline_t));
   ASSERT(tl);
 
+  // An aborted attempt is forgotten, except that latencies count from the first submission
   uint64_t first_submit = UINT64_MAX, last_done = 0;
+  int aborts = 0;
   for (uint32_t i = 0; i < num_events; i++) {
     const pmlog_evt_t *e = &pmlog_evt_buf[i];
     timeline_t *t = &tl[e->txn_id];
     switch (e->kind) {
-      case PMLOG_SUBMIT:      t->submit = e->tsc; break;
+      case PMLOG_SUBMIT:      if (!t->submit) t->submit = e->tsc; break;
       case PMLOG_SCHED_READY: t->sched  = e->tsc; break;
       case PMLOG_WORK_RECV:   t->work   = e->tsc; break;
       case PMLOG_DONE:        t->done   = e->tsc; t->puppet = e->aux_data; break;
       case PMLOG_CLEANUP:     t->cleanup = e->tsc; break;
+      case PMLOG_ABORT:       t->sched = t->work = t->done = 0; aborts++; break;
       default: FATAL("Unexpected log kind");
     }
   }
+  if (aborts) {
+    INFO("%d aborted attempts (%.2f per txn)", aborts, (double) aborts / wl->num_txns);
+  }
 
   /*
   Record first_submit and last_done. Also complain about incomplete transactions.
@@ -225,13 +231,16 @@ int main(int argc, char *argv[])
     // Create an array of interesting transactions sorted by scheduled time
     for (int i = 0; i < wl->num_txns; i++) {
       if (!tl[i].sched || !tl[i].done) continue; 
+      // With aborts, only the cleanup shows that an attempt committed, and a full log may lack it
+      if (aborts && !tl[i].cleanup) continue;
       if (tl[i].submit > tl[i].sched || tl[i].sched > tl[i].done) continue;
       sched[sched_cnt++] = (sched_evt_t){ tl[i].sched, tl[i].done, i };
     }
     qsort(sched, sched_cnt, sizeof(sched_evt_t), &compare_sched_evt);
 
     // We'll maintain a list of active transactions
-    int active_ids[MAX_ACTIVE_PER_PUPPET * MAX_PUPPETS];
+    // Puppets may hold several transactions each, so only the number of scheduled ones bounds it
+    int *active_ids = (int *) malloc((sched_cnt + 1) * sizeof(int));
     int active_cnt = 0;
 
     // Go through the transactions in order
@@ -269,8 +278,7 @@ int main(int argc, char *argv[])
       }
 
       // Add current txn to active set
-      if (active_cnt < num_puppets)
-        active_ids[active_cnt++] = cur_id;
+      active_ids[active_cnt++] = cur_id;
     }
 
     if (conflicts) {
@@ -279,6 +287,7 @@ int main(int argc, char *argv[])
       INFO("No conflicting pairs of scheduled transactions.");
     }
 
+    free(active_ids);
     free(sched);
   }
 
@@ -7,6 +7,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdatomic.h>
+#include <stdalign.h>
 #include <string.h>
 #include <stdarg.h>
 #include <unistd.h>
@@ -23,10 +24,12 @@
 #include "pmutils.h"
 #include "workload.h"
 
-// #define SCHEDULER_CORE 0
+#define SCHEDULER_CORE 0
 #define MAIN_CORE 1
-#define CLIENT_CORE 2
-#define PUPPET_CORE_START 3
+#define CLIENT_CORE_START 2
+// puppets are pinned right after the clients
+// Scheduler shard i runs on SCHEDULER_CORE + i, so shard 1 shares the mostly sleeping main thread's
+// core and every further shard moves clients and puppets one core up
 
 /*
 Configuration
@@ -36,6 +39,7 @@ Configuration
 #define DEF_WORK_US         0
 #define DEF_NUM_CLIENTS     1
 #define DEF_NUM_PUPPETS     8
+#define DEF_BATCH_SIZE      1
 #define DEF_SAMPLE_SHIFT    0
 #define DEF_WORKLOAD_FILE   "transactions.csv"
 #define DEF_LOG_FILE        ""
@@ -46,8 +50,20 @@ static const char *usage =
   "  --input FILE         Transaction CSV file (default transactions.csv)\n"
   "  --timeout SEC        Benchmark wall‑clock duration (default 10)\n"
   "  --work-us USEC       Simulated work per txn (default 0)\n"
+  "  --work-skew K        Every K-th txn does K times the simulated work (default 1, uniform)\n"
+  "  --obj-bytes N        Per-object data, a multiple of 64 bytes, each txn reads or updates (default 0)\n"
   "  --clients N          Number of client threads (default 1)\n"
   "  --puppets N          Number of worker (puppet) threads (default 8)\n"
+  "  --dispatch POLICY    Puppet selection: rr, least-loaded or affinity (default rr)\n"
+  "  --policy NAME        Scheduling policy of the software backends (default $PMHW_POLICY or the board's)\n"
+  "  --batch N            Submit, poll and report up to N txns per call (default 1)\n"
+  "  --zero-copy          Submit by filling queue slots in place (reserve/commit)\n"
+  "  --try                Submit with pmhw_try_schedule, waiting for queue space in the client\n"
+  "  --wait STRATEGY      Waiting on queues: spin, pause or sleep (default spin)\n"
+  "  --pending-depth N    Submission queue depth per client (default 32)\n"
+  "  --active-depth N     In-flight txns per puppet (default 32)\n"
+  "  --steal              Let idle puppets take txns scheduled for busy ones (software backends)\n"
+  "  --shards K           Scheduler threads, each owning a slice of the objects and puppets (software backends, default 1)\n"
   "  --sample-shift S     Log 1 event every 2^S txns (default 0)\n"
   "  --log FILE           Binary log output (if set)\n"
   "  --dump FILE          Human dump after run (if set)\n"
@@ -57,8 +73,17 @@ static const char *usage =
 
 static int test_timeout_sec = DEF_TIMEOUT_SEC;
 static int work_sim_us      = DEF_WORK_US;
+static int work_skew        = 1;
+static int obj_bytes        = 0;
 static int num_clients      = DEF_NUM_CLIENTS;
 static int num_puppets      = DEF_NUM_PUPPETS;
+static pmhw_dispatch_t dispatch = PMHW_DISPATCH_ROUND_ROBIN;
+static int batch_size       = DEF_BATCH_SIZE;
+static pmhw_wait_t wait_strategy = PMHW_WAIT_SPIN;
+static char policy_name[100]       = "";
+static int pending_depth    = PMHW_DEF_PENDING_PER_CLIENT;
+static int active_depth     = PMHW_DEF_ACTIVE_PER_PUPPET;
+static int num_shards       = 1;
 
 static int  sample_period           = 1 << DEF_SAMPLE_SHIFT;
 static char log_filename[1000]      = DEF_LOG_FILE;
@@ -68,35 +93,87 @@ static char workload_filename[1000] = DEF_WORKLOAD_FILE;
 static bool status_updates = false;
 static bool live_dump      = false;
 static bool limit_client   = false; // limit client throughput for better latency measurements
+static bool zero_copy      = false; // submit through pmhw_reserve_txn/pmhw_commit_txn
+static bool try_schedule   = false; // submit through pmhw_try_schedule
+static bool work_stealing  = false;
 
 static double   cpu_freq        = 0.0;  // set at beginning of main
 static uint64_t work_sim_cycles = 0;    // ditto
 
 
 /*
-Worker thread state
+Worker thread state, one cache line per puppet so their counters do not false-share
 */
 typedef struct {
-  pthread_t thread;
+  alignas(64) pthread_t thread;
   int id;
   uint64_t num_completed;
-
-  /* optional: explicit padding so sizeof(puppet_t) == 64  */
-  char _pad[64 - (sizeof(pthread_t) +
-                  sizeof(int) +
-                  sizeof(uint64_t)) % 64];
+  uint64_t num_touched;   // with --obj-bytes: objects whose data this puppet went through
+  uint64_t touch_tsc;     // ditto, cycles spent on it
+  uint64_t checksum;      // keeps the reads from being optimized away
+  double cpu_time;
 } puppet_t;
 
+/*
+Client thread state
+*/
+typedef struct {
+  pthread_t thread;
+  int id;
+  uint64_t num_submitted;
+  uint64_t num_resubmitted;   // aborted attempts submitted again
+  uint64_t num_found_full;    // with --try: submissions that found the queue full
+  uint64_t full_tsc;          // with --try: cycles spent waiting for queue space
+  uint64_t depth_sum;         // with --try: queue depth right after each submission
+  uint64_t start_tsc, end_tsc;
+  double cpu_time;
+} client_t;
+
 /*
 Transaction buffer
 */
 static workload_t *workload;
 
+/*
+Per-object data for --obj-bytes, obj_bytes per object ID in the workload
+*/
+static uint8_t *obj_data;
+
 /*
 Global state
 */
 volatile atomic_bool keep_polling __attribute__((aligned(64))) = ATOMIC_VAR_INIT(true);
-static puppet_t puppets[MAX_PUPPETS];
+static puppet_t *puppets;
+static client_t *clients;
+
+/*
+CPU time consumed by the calling thread so far, in seconds
+*/
+static double thread_cpu_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+Go through the data of every object a transaction accesses, one word per cache line,
+updating the objects it writes. Where the data was last touched decides how long this takes.
+*/
+static void touch_objects(puppet_t *puppet, const txn_t *txn) {
+  uint64_t start = __rdtsc();
+  uint64_t sum = 0;
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    uint64_t *data = (uint64_t *)(obj_data + (txn->objs[i] & ~(1ULL << 63)) * obj_bytes);
+    if (obj_is_write(txn->objs[i])) {
+      for (int k = 0; k < obj_bytes / 8; k += 8) data[k]++;
+    } else {
+      for (int k = 0; k < obj_bytes / 8; k += 8) sum += data[k];
+    }
+  }
+  puppet->checksum += sum;
+  puppet->num_touched += txn->num_objs;
+  puppet->touch_tsc += __rdtsc() - start;
+}
 
 /*
 Worker thread
@@ -106,53 +183,147 @@ static void *puppet_thread(void *arg) {
   puppet_t *puppet = (puppet_t *)arg;
   int puppet_id = puppet->id;
 
-  pin_thread_to_core(PUPPET_CORE_START + puppet_id);
+  pin_thread_to_core(CLIENT_CORE_START + num_shards - 1 + num_clients + puppet_id);
+
+  txn_id_t *txn_ids = (txn_id_t *) malloc(sizeof(txn_id_t) * batch_size);
+  ASSERT(txn_ids);
 
   while (1) {
     // Poll for work assignment
-    txn_id_t txn_id;
-    if (!pmhw_poll_scheduled(puppet_id, &txn_id)) break;
+    int n;
+    if (batch_size > 1) {
+      n = pmhw_poll_scheduled_batch(puppet_id, txn_ids, batch_size);
+    } else {
+      n = pmhw_poll_scheduled(puppet_id, &txn_ids[0]) ? 1 : 0;
+    }
+    if (n == 0) break;
 
-    pmlog_record(txn_id, PMLOG_WORK_RECV, puppet_id);
+    for (int i = 0; i < n; ++i) {
+      pmlog_record(txn_ids[i], PMLOG_WORK_RECV, puppet_id);
+      if (obj_data) touch_objects(puppet, &workload->txns[txn_ids[i]]);
 
-    // Simulate transaction processing work by busy looping
-    uint64_t start, end;
-    start = __rdtsc();
-    do {
-      end = __rdtsc();
-    } while (end - start < work_sim_cycles);
+      // Simulate transaction processing work by busy looping
+      uint64_t cycles = txn_ids[i] % work_skew == 0 ? work_sim_cycles * work_skew : work_sim_cycles;
+      uint64_t start, end;
+      start = __rdtsc();
+      do {
+        end = __rdtsc();
+      } while (end - start < cycles);
+    }
 
-    pmhw_report_done(puppet_id, txn_id);
+    if (batch_size > 1) {
+      pmhw_report_done_batch(puppet_id, txn_ids, n);
+    } else {
+      pmhw_report_done(puppet_id, txn_ids[0]);
+    }
 
-    puppet->num_completed++;
+    puppet->num_completed += n;
   }
 
+  free(txn_ids);
+  puppet->cpu_time = thread_cpu_time();
   return NULL;
 }
 
+// How long a client that has submitted everything sleeps between polls for aborted transactions
+#define ABORT_POLL_US 10
+
 /*
-Client thread (submits transactions)
+Submit again whatever Puppetmaster aborted. Returns the number of transactions resubmitted.
 */
-static void *client_thread(void *arg) {
-  (void)arg;
+static int resubmit_aborted(client_t *client) {
+  txn_id_t txn_ids[64];
+  int n = pmhw_poll_aborted(client->id, txn_ids, 64);
+  for (int i = 0; i < n; ++i) pmhw_schedule(client->id, &workload->txns[txn_ids[i]]);
+  client->num_resubmitted += n;
+  return n;
+}
 
-  pin_thread_to_core(CLIENT_CORE);
-  pmlog_start_timer(cpu_freq);
+/*
+Submit through pmhw_try_schedule, waiting for room in the client rather than inside Puppetmaster,
+so the time spent waiting (queueing delay) is known separately from the scheduling delay.
+Returns false if Puppetmaster shut down.
+*/
+static bool try_submit(client_t *client, const txn_t *txn) {
+  uint64_t start = 0;
+  pmhw_status_t status;
+  while ((status = pmhw_try_schedule(client->id, txn)) == PMHW_QUEUE_FULL) {
+    if (!start) {
+      start = __rdtsc();
+      client->num_found_full++;
+    }
+    _mm_pause();
+  }
+  if (start) client->full_tsc += __rdtsc() - start;
+  if (status != PMHW_ACCEPTED) return false;
+  client->depth_sum += pmhw_queue_depth(client->id);
+  return true;
+}
 
-  uint64_t client_sim_cycles = work_sim_cycles;
-  if (work_sim_cycles == 0) client_sim_cycles = cpu_freq * 1e-6 / num_puppets;
+static uint64_t num_committed() {
+  pmhw_stats_t stats;
+  pmhw_get_stats(&stats);
+  return stats.num_committed;
+}
 
-  for (int i = 0; i < workload->num_txns; ++i) {
-    pmhw_schedule(0, &workload->txns[i]);
+/*
+Client thread (submits transactions)
+The workload is split into contiguous ranges, one per client, so batches can be submitted in place.
+Under optimistic scheduling, the client keeps submitting aborted transactions again until all have committed.
+*/
+static void *client_thread(void *arg) {
+  client_t *client = (client_t *)arg;
+  int client_id = client->id;
+
+  pin_thread_to_core(CLIENT_CORE_START + num_shards - 1 + client_id);
+
+  // Each client is paced so that all clients together keep the same aggregate rate
+  uint64_t client_sim_cycles = work_sim_cycles * num_clients;
+  if (work_sim_cycles == 0) client_sim_cycles = cpu_freq * 1e-6 * num_clients / num_puppets;
+
+  int first = (int)((int64_t)workload->num_txns * client_id / num_clients);
+  int last  = (int)((int64_t)workload->num_txns * (client_id + 1) / num_clients);
+
+  client->start_tsc = __rdtsc();
+  for (int i = first; i < last; i += batch_size) {
+    int n = last - i < batch_size ? last - i : batch_size;
+    if (zero_copy) {
+      for (int j = i; j < i + n; ++j) {
+        const txn_t *src = &workload->txns[j];
+        packed_txn_t *dst = pmhw_reserve_txn(client_id);
+        if (!dst) break;
+        dst->id = src->id;
+        dst->aux_data = src->aux_data;
+        dst->num_objs = src->num_objs;
+        for (int k = 0; k < (int)src->num_objs; ++k) dst->objs[k] = src->objs[k];
+        pmhw_commit_txn(client_id, dst);
+      }
+    } else if (try_schedule) {
+      for (int j = i; j < i + n; ++j) {
+        if (!try_submit(client, &workload->txns[j])) break;
+      }
+    } else if (batch_size > 1) {
+      pmhw_schedule_batch(client_id, &workload->txns[i], n);
+    } else {
+      pmhw_schedule(client_id, &workload->txns[i]);
+    }
+    client->num_submitted += n;
+    resubmit_aborted(client);
 
     if (limit_client && client_sim_cycles > 0) {
       uint64_t start, end;
       start = __rdtsc();
       do {
         end = __rdtsc();
-      } while (end - start < client_sim_cycles);
+      } while (end - start < client_sim_cycles * n);
     }
   }
+  client->end_tsc = __rdtsc();
+
+  while (atomic_load_explicit(&keep_polling, memory_order_relaxed) && num_committed() < (uint64_t)workload->num_txns) {
+    if (resubmit_aborted(client) == 0) usleep(ABORT_POLL_US);
+  }
+  client->cpu_time = thread_cpu_time();
 
   return NULL;
 }
@@ -172,18 +343,30 @@ static void parse_args(int argc, char **argv) {
     {"work-us",      required_argument, 0, 'w'},
     {"clients",      required_argument, 0, 'c'},
     {"puppets",      required_argument, 0, 'p'},
+    {"dispatch",     required_argument, 0,  4 },
+    {"batch",        required_argument, 0, 'b'},
+    {"wait",         required_argument, 0,  5 },
+    {"pending-depth",required_argument, 0,  6 },
+    {"active-depth", required_argument, 0,  7 },
     {"sample-shift", required_argument, 0, 's'},
     {"log",          required_argument, 0, 'l'},
     {"dump",         required_argument, 0, 'd'},
     {"status",       no_argument,       0,  1 },
     {"live-dump",    no_argument,       0,  2 },
     {"limit",        no_argument,       0,  3 },
+    {"zero-copy",    no_argument,       0,  8 },
+    {"policy",       required_argument, 0,  9 },
+    {"steal",        no_argument,       0, 10 },
+    {"work-skew",    required_argument, 0, 11 },
+    {"try",          no_argument,       0, 12 },
+    {"obj-bytes",    required_argument, 0, 14 },
+    {"shards",       required_argument, 0, 13 },
     {"help",         no_argument,       0, 'h'},
     {0,0,0,0}
   };
 
   int opt, idx;
-  while ((opt = getopt_long(argc, argv, "f:t:w:c:p:s:l:d:h", opts, &idx)) != -1)
+  while ((opt = getopt_long(argc, argv, "f:t:w:c:p:b:s:l:d:h", opts, &idx)) != -1)
   {
     switch (opt) {
       case 'f': strncpy(workload_filename, optarg, sizeof workload_filename - 1); break;
@@ -191,23 +374,50 @@ static void parse_args(int argc, char **argv) {
       case 'w': work_sim_us      = atoi(optarg);  break;
       case 'c': num_clients      = atoi(optarg);  break;
       case 'p': num_puppets      = atoi(optarg);  break;
+      case 'b': batch_size       = atoi(optarg);  break;
       case 's': sample_period    = 1 << atoi(optarg); break;
       case 'l': strncpy(log_filename,  optarg, sizeof log_filename - 1); break;
       case 'd': strncpy(dump_filename, optarg, sizeof dump_filename - 1); break;
       case  1 : status_updates = true;  break;
       case  2 : live_dump      = true;  break;
       case  3 : limit_client   = true;  break;
+      case  8 : zero_copy      = true;  break;
+      case  9 : strncpy(policy_name, optarg, sizeof policy_name - 1); break;
+      case 10 : work_stealing    = true;  break;
+      case 11 : work_skew        = atoi(optarg);  break;
+      case 12 : try_schedule     = true;  break;
+      case 13 : num_shards       = atoi(optarg);  break;
+      case 14 : obj_bytes        = atoi(optarg);  break;
+      case  4 :
+        if (strcmp(optarg, "rr") == 0) dispatch = PMHW_DISPATCH_ROUND_ROBIN;
+        else if (strcmp(optarg, "least-loaded") == 0) dispatch = PMHW_DISPATCH_LEAST_LOADED;
+        else if (strcmp(optarg, "affinity") == 0) dispatch = PMHW_DISPATCH_AFFINITY;
+        else FATAL("Unknown dispatch policy %s", optarg);
+        break;
+      case  5 :
+        if (strcmp(optarg, "spin") == 0) wait_strategy = PMHW_WAIT_SPIN;
+        else if (strcmp(optarg, "pause") == 0) wait_strategy = PMHW_WAIT_PAUSE;
+        else if (strcmp(optarg, "sleep") == 0) wait_strategy = PMHW_WAIT_SLEEP;
+        else FATAL("Unknown wait strategy %s", optarg);
+        break;
+      case  6 : pending_depth    = atoi(optarg);  break;
+      case  7 : active_depth     = atoi(optarg);  break;
       case 'h':
       default:  fputs(usage, stderr); exit(0);
     }
   }
 
   /* sanity checks */
-  if (test_timeout_sec <= 0 || work_sim_us < 0 ||
-    num_clients <= 0   || num_puppets <= 0) {
+  if (test_timeout_sec <= 0 || work_sim_us < 0 || work_skew <= 0 ||
+    num_clients <= 0   || num_puppets <= 0 || batch_size <= 0 ||
+    pending_depth <= 0 || active_depth <= 0 || num_shards <= 0 || obj_bytes < 0 || obj_bytes % 64 != 0) {
     FATAL("Invalid argument value\n");
   }
 
+  if (zero_copy && try_schedule) {
+    FATAL("--zero-copy and --try are mutually exclusive\n");
+  }
+
   if (workload_filename[0] == '\0') {
     FATAL("Workload not provided\n");
   }
@@ -235,9 +445,39 @@ int main(int argc, char *argv[]) {
 
   ASSERT(workload_filename[0]);
   workload = parse_workload(workload_filename);
+  if (obj_bytes > 0) {
+    obj_id_t max_obj = 0;
+    for (int i = 0; i < workload->num_txns; ++i) {
+      for (int k = 0; k < (int)workload->txns[i].num_objs; ++k) {
+        obj_id_t obj = workload->txns[i].objs[k] & ~(1ULL << 63);
+        if (obj > max_obj) max_obj = obj;
+      }
+    }
+    obj_data = (uint8_t *) aligned_alloc(64, (max_obj + 1) * obj_bytes);
+    ASSERT(obj_data);
+    memset(obj_data, 0, (max_obj + 1) * obj_bytes);
+  }
 
   pmlog_init(workload->num_txns * 6, sample_period, live_dump ? stdout : NULL);
-  pmhw_init(num_clients, num_puppets); // Reminder: this creates a scheduler thread
+  pmhw_config_t config = pmhw_config_default(num_clients, num_puppets);
+  config.pending_per_client = pending_depth;
+  config.active_per_puppet = active_depth;
+  config.scheduler_core = SCHEDULER_CORE;
+  config.dispatch = dispatch;
+  config.wait = wait_strategy;
+  config.policy = policy_name[0] ? policy_name : NULL;
+  config.work_stealing = work_stealing;
+  config.num_shards = num_shards;
+  pmhw_init_ex(&config); // Reminder: this creates a scheduler thread
+  if (try_schedule && pmhw_queue_depth(0) < 0) {
+    FATAL("--try is not supported by this backend\n");
+  }
+
+  // calloc only guarantees 16-byte alignment, which would split puppets across cache lines
+  puppets = (puppet_t *) aligned_alloc(alignof(puppet_t), num_puppets * sizeof(puppet_t));
+  clients = (client_t *) calloc(num_clients, sizeof(client_t));
+  ASSERT(puppets && clients);
+  memset(puppets, 0, num_puppets * sizeof(puppet_t));
 
   /*
 
@@ -251,27 +491,29 @@ int main(int argc, char *argv[]) {
   }
 
   /*
-  Start client
+  Start clients
   */
 
-  pthread_t client;
-  pthread_create(&client, NULL, client_thread, NULL); // client_thread starts the timer
+  pmlog_start_timer(cpu_freq);
+  for (int i = 0; i < num_clients; ++i) {
+    clients[i].id = i;
+    clients[i].num_submitted = 0;
+    pthread_create(&clients[i].thread, NULL, client_thread, &clients[i]);
+  }
 
   /*
   Wait until we're sure everything is done
   */
 
-  // Every second, check whether everything has finished so we can break out early
+  // Every second, check whether everything has finished so we can break out early.
+  // Completions of aborted attempts do not count, so ask Puppetmaster rather than the puppets.
   bool done = false;
   bool success = false;
   int prev = -1;
   for (int second = 0; second < (int) test_timeout_sec; second++) {
-    int sum = 0;
-    for (int i = 0; i < num_puppets; ++i) {
-      sum += puppets[i].num_completed;
-    }
+    int sum = (int) num_committed();
     if (status_updates) {
-      INFO("%d/%d transactions completed", sum, workload->num_txns);
+      INFO("%d/%d transactions committed", sum, workload->num_txns);
     }
     if (sum == prev) {
       done = true;
@@ -297,10 +539,55 @@ int main(int argc, char *argv[]) {
     // Graceful cleanup if possible (otherwise, don't bother)
     pmhw_shutdown();
     atomic_store_explicit(&keep_polling, false, memory_order_relaxed);
-    pthread_join(client, NULL);
+    for (int i = 0; i < num_clients; ++i) {
+      pthread_join(clients[i].thread, NULL);
+    }
     for (int i = 0; i < num_puppets; ++i) {
       pthread_join(puppets[i].thread, NULL);
     }
+
+    // Per-client submission throughput and per-thread CPU usage
+    for (int i = 0; i < num_clients; ++i) {
+      double elapsed = (clients[i].end_tsc - clients[i].start_tsc) / cpu_freq;
+      INFO("Client %d submitted %lu txns in %.6f s (%.2f txn/s), CPU time %.6f s",
+           i, clients[i].num_submitted, elapsed, clients[i].num_submitted / elapsed, clients[i].cpu_time);
+      if (try_schedule) {
+        INFO("Client %d found its queue full %lu times, waited %.6f s for space, mean queue depth %.2f",
+             i, clients[i].num_found_full, clients[i].full_tsc / cpu_freq,
+             (double)clients[i].depth_sum / clients[i].num_submitted);
+      }
+    }
+    uint64_t num_touched = 0, touch_tsc = 0;
+    for (int i = 0; i < num_puppets; ++i) {
+      INFO("Puppet %d completed %lu txns, CPU time %.6f s",
+           i, puppets[i].num_completed, puppets[i].cpu_time);
+      num_touched += puppets[i].num_touched;
+      touch_tsc += puppets[i].touch_tsc;
+    }
+    if (num_touched > 0) {
+      INFO("Going through %d bytes of object data took %.1f cycles per object on average",
+           obj_bytes, (double)touch_tsc / num_touched);
+    }
+    pmhw_stats_t stats;
+    pmhw_get_stats(&stats);
+    if (stats.num_aborted > 0) {
+      uint64_t resubmitted = 0;
+      for (int i = 0; i < num_clients; ++i) resubmitted += clients[i].num_resubmitted;
+      INFO("Committed %lu txns, aborted %lu attempts (%.2f%% abort rate), resubmitted %lu",
+           stats.num_committed, stats.num_aborted,
+           100.0 * stats.num_aborted / (stats.num_committed + stats.num_aborted), resubmitted);
+    }
+    if (num_shards > 1) {
+      INFO("%lu of %lu txns spanned several of the %d scheduler shards (%.2f%% cross-shard)",
+           stats.num_cross_shard, stats.num_committed, num_shards,
+           100.0 * stats.num_cross_shard / stats.num_committed);
+    }
+    if (stats.num_summary_checked > 0) {
+      INFO("Summary stalls, estimated from a sample: %lu true conflicts (%.2f/s), %lu false positives (%.2f/s, %.2f%%)",
+           stats.num_true_conflicts, stats.num_true_conflicts / stats.elapsed,
+           stats.num_false_positives, stats.num_false_positives / stats.elapsed,
+           100.0 * stats.num_false_positives / stats.num_summary_checked);
+    }
   }
 
   /*
@@ -322,6 +609,9 @@ int main(int argc, char *argv[]) {
   Don't leak memory
   */
   free(workload);
+  free(obj_data);
+  free(puppets);
+  free(clients);
   pmlog_cleanup();
 
   return 0;
@@ -0,0 +1,135 @@
+// active_set.h - Slot-indexed set of scheduled transactions
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "pmhw.h"
+#include "pmutils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+Every scheduled transaction occupies one slot until its completion is drained.
+Free slots are kept on a stack and occupied slots in a bitmap, so insertion and removal
+are O(1) and completions may arrive in any order. An open-addressing index maps
+transaction IDs to slots so a completion finds its slot without scanning.
+*/
+typedef struct {
+  txn_t txn;
+  int puppet;
+  int client;          // who submitted it
+} active_slot_t;
+
+typedef struct {
+  active_slot_t *slots;
+  int *free_list;      // stack of free slot numbers
+  int num_free;
+  uint64_t *bitmap;    // bit set for every occupied slot
+  int *index;          // txn id -> slot, -1 if empty
+  int index_mask;
+  int capacity;
+} active_set_t;
+
+static inline int active_set_home(const active_set_t *as, txn_id_t id) {
+  return (int)((id * 0x9e3779b97f4a7c15ull) >> 32) & as->index_mask;
+}
+
+static inline void active_set_init(active_set_t *as, int capacity) {
+  int index_size = 1;
+  while (index_size < 2 * capacity) index_size <<= 1;
+
+  as->slots = (active_slot_t *) malloc(sizeof(active_slot_t) * capacity);
+  as->free_list = (int *) malloc(sizeof(int) * capacity);
+  as->bitmap = (uint64_t *) calloc((capacity + 63) / 64, sizeof(uint64_t));
+  as->index = (int *) malloc(sizeof(int) * index_size);
+  ASSERT(as->slots && as->free_list && as->bitmap && as->index);
+
+  as->capacity = capacity;
+  as->index_mask = index_size-1;
+  as->num_free = capacity;
+  for (int i = 0; i < capacity; ++i) as->free_list[i] = capacity-1-i;
+  for (int i = 0; i < index_size; ++i) as->index[i] = -1;
+}
+
+static inline void active_set_free(active_set_t *as) {
+  free(as->slots);
+  free(as->free_list);
+  free(as->bitmap);
+  free(as->index);
+  as->slots = NULL;
+  as->free_list = NULL;
+  as->bitmap = NULL;
+  as->index = NULL;
+  as->capacity = 0;
+}
+
+static inline int active_set_size(const active_set_t *as) {
+  return as->capacity - as->num_free;
+}
+
+// Insert a transaction, returning its slot. The set must not be full.
+static inline int active_set_insert(active_set_t *as, const txn_t *txn, int puppet, int client) {
+  ASSERT(as->num_free > 0);
+  int slot = as->free_list[--as->num_free];
+  as->slots[slot].txn = *txn;
+  as->slots[slot].puppet = puppet;
+  as->slots[slot].client = client;
+  as->bitmap[slot / 64] |= 1ull << (slot % 64);
+
+  int i = active_set_home(as, txn->id);
+  while (as->index[i] >= 0) i = (i+1) & as->index_mask;
+  as->index[i] = slot;
+  return slot;
+}
+
+// Find the slot of a transaction, or -1 if it is not active
+static inline int active_set_find(const active_set_t *as, txn_id_t id) {
+  for (int i = active_set_home(as, id); as->index[i] >= 0; i = (i+1) & as->index_mask) {
+    if (as->slots[as->index[i]].txn.id == id) return as->index[i];
+  }
+  return -1;
+}
+
+// Remove the transaction in a slot, which must be occupied
+static inline void active_set_remove(active_set_t *as, int slot) {
+  // Locate the index entry, then close the hole with backward-shift deletion
+  int i = active_set_home(as, as->slots[slot].txn.id);
+  while (as->index[i] != slot) i = (i+1) & as->index_mask;
+  int j = i;
+  while (true) {
+    j = (j+1) & as->index_mask;
+    if (as->index[j] < 0) break;
+    int home = active_set_home(as, as->slots[as->index[j]].txn.id);
+    bool in_range = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+    if (!in_range) {
+      as->index[i] = as->index[j];
+      i = j;
+    }
+  }
+  as->index[i] = -1;
+
+  as->bitmap[slot / 64] &= ~(1ull << (slot % 64));
+  as->free_list[as->num_free++] = slot;
+}
+
+// First occupied slot at or after start, or -1. Iterate with
+//   for (int s = active_set_next(as, 0); s >= 0; s = active_set_next(as, s+1))
+static inline int active_set_next(const active_set_t *as, int start) {
+  if (start >= as->capacity) return -1;
+  int w = start / 64;
+  uint64_t bits = as->bitmap[w] & (~0ull << (start % 64));
+  while (!bits) {
+    if (++w >= (as->capacity + 63) / 64) return -1;
+    bits = as->bitmap[w];
+  }
+  int slot = w * 64 + __builtin_ctzll(bits);
+  return slot < as->capacity ? slot : -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
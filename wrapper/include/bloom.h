@@ -1,9 +1,13 @@
 // bloom.h - Bloom filter interface for conflict checking
 #pragma once
 
+#include <stdalign.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include <immintrin.h>
+
+#include "pmhw.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,6 +33,9 @@ extern "C" {
 #error "Each partition of Bloom filter must have number of bits divisible by 64"
 #endif
 
+// Each hash function owns its own partition of the filter, like NumBloomParts in hardware
+#define BLOOM_PART_BITS (BLOOM_TOTAL_BITS / BLOOM_NUM_HASHES)
+
 // --- Bloom Filter Structure ---
 
 typedef struct {
@@ -37,16 +44,17 @@ typedef struct {
 
 // --- Internal Hashing Helper ---
 
+// Multiply-shift hashing, different constant per hash function
+static const uint64_t bloom_hash_constants[] = {
+  0x9e3779b97f4a7c15ull, 0xc6a4a7935bd1e995ull,
+  0x2545f4914f6cdd1dull, 0x21c64e4276c9f809ull,
+  0x5851f42d4c957f2dull, 0xda942042e4dd58b5ull,
+  0x14057b7ef767814full, 0x2f8b15c6c8b3a3c5ull
+};
+
 static inline uint32_t bloom_hash(uint64_t x, int idx) {
-  // Multiply-shift hashing, different constant per hash function
-  static const uint64_t hash_constants[] = {
-    0x9e3779b97f4a7c15ull, 0xc6a4a7935bd1e995ull,
-    0x2545f4914f6cdd1dull, 0x21c64e4276c9f809ull,
-    0x5851f42d4c957f2dull, 0xda942042e4dd58b5ull,
-    0x14057b7ef767814full, 0x2f8b15c6c8b3a3c5ull
-  };
-  uint64_t h = x * hash_constants[idx];
-  return (h >> 46) % (BLOOM_TOTAL_BITS / BLOOM_NUM_HASHES);
+  uint64_t h = x * bloom_hash_constants[idx];
+  return (h >> 46) % BLOOM_PART_BITS;
 }
 
 // --- API ---
@@ -59,7 +67,7 @@ static inline void bloom_init(bloom_t *bf) {
 // Insert an object ID into the Bloom filter
 static inline void bloom_insert(bloom_t *bf, uint64_t objid) {
   for (int i = 0; i < BLOOM_NUM_HASHES; ++i) {
-    uint32_t bitpos = bloom_hash(objid, i);
+    uint32_t bitpos = i * BLOOM_PART_BITS + bloom_hash(objid, i);
     bf->bits[bitpos / 64] |= (1ull << (bitpos % 64));
   }
 }
@@ -67,7 +75,7 @@ static inline void bloom_insert(bloom_t *bf, uint64_t objid) {
 // Query whether an object ID *may* be present (could be false positive)
 static inline bool bloom_query(const bloom_t *bf, uint64_t objid) {
   for (int i = 0; i < BLOOM_NUM_HASHES; ++i) {
-    uint32_t bitpos = bloom_hash(objid, i);
+    uint32_t bitpos = i * BLOOM_PART_BITS + bloom_hash(objid, i);
     if (!(bf->bits[bitpos / 64] & (1ull << (bitpos % 64)))) {
       return false;
     }
@@ -75,6 +83,354 @@ static inline bool bloom_query(const bloom_t *bf, uint64_t objid) {
   return true;
 }
 
+/*
+Reader/writer summary: reads and writes go into separate filters, so two readers of the same
+object do not conflict, matching check_txn_conflict. A write is checked against both filters,
+a read only against the writes.
+*/
+typedef struct {
+  bloom_t reads;
+  bloom_t writes;
+} bloom_rw_t;
+
+static inline void bloom_rw_init(bloom_rw_t *bf) {
+  bloom_init(&bf->reads);
+  bloom_init(&bf->writes);
+}
+
+static inline void bloom_rw_insert(bloom_rw_t *bf, uint64_t objid, bool write) {
+  bloom_insert(write ? &bf->writes : &bf->reads, objid);
+}
+
+// Whether an access *may* conflict with what was inserted (could be false positive)
+static inline bool bloom_rw_query(const bloom_rw_t *bf, uint64_t objid, bool write) {
+  return bloom_query(&bf->writes, objid) || (write && bloom_query(&bf->reads, objid));
+}
+
+/*
+Whole-transaction variants: hash every object of a txn_t at once and answer for the transaction.
+The AVX2 kernels take four objects per vector, emulating the 64-bit multiply of bloom_hash with
+32-bit ones and probing one hash function of all four with a gather. Like the scalar query, they
+stop once every object has missed a bit. AVX2 has no scatter, so inserts only vectorize the hashing.
+The _txn functions pick a kernel the CPU supports at runtime, like check_txn_conflict.
+all_writes treats every access as a write, as in a unified summary.
+They lose to the per-object loop on small, contended object pools (bloom_bench), so the
+scheduler policies only use them with SIM_BLOOM_TXN_KERNELS set.
+*/
+static inline bool bloom_query_txn_scalar(const bloom_t *bf, const txn_t *txn) {
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    if (bloom_query(bf, txn->objs[i] & ~(1ULL << 63))) return true;
+  }
+  return false;
+}
+
+static inline bool bloom_rw_query_txn_scalar(const bloom_rw_t *bf, const txn_t *txn, bool all_writes) {
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    if (bloom_rw_query(bf, txn->objs[i] & ~(1ULL << 63), all_writes || obj_is_write(txn->objs[i]))) return true;
+  }
+  return false;
+}
+
+#if MAX_TXN_OBJS == 16 && (BLOOM_PART_BITS & (BLOOM_PART_BITS-1)) == 0
+#define BLOOM_TXN_AVX2 1
+
+// Bit positions of four object IDs (read/write flag already cleared) for hash function idx
+__attribute__((target("avx2")))
+static inline __m256i bloom_positions_avx2(__m256i ids, int idx) {
+  __m256i c = _mm256_set1_epi64x((long long)bloom_hash_constants[idx]);
+  // Low 64 bits of ids * c from 32x32-bit products
+  __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(ids, 32), c),
+                                   _mm256_mul_epu32(ids, _mm256_srli_epi64(c, 32)));
+  __m256i h = _mm256_add_epi64(_mm256_mul_epu32(ids, c), _mm256_slli_epi64(cross, 32));
+  return _mm256_add_epi64(_mm256_and_si256(_mm256_srli_epi64(h, 46), _mm256_set1_epi64x(BLOOM_PART_BITS-1)),
+                          _mm256_set1_epi64x((long long)idx * BLOOM_PART_BITS));
+}
+
+// Whether any of the selected lanes (all ones) has all of its bits set.
+// Stops as soon as every selected lane has missed one, like the scalar query.
+__attribute__((target("avx2")))
+static inline bool bloom_probe_avx2(const bloom_t *bf, __m256i ids, __m256i lanes) {
+  __m256i present = _mm256_and_si256(lanes, _mm256_set1_epi64x(1));
+  for (int i = 0; i < BLOOM_NUM_HASHES; ++i) {
+    __m256i pos = bloom_positions_avx2(ids, i);
+    __m256i words = _mm256_i64gather_epi64((const long long *)bf->bits, _mm256_srli_epi64(pos, 6), 8);
+    present = _mm256_and_si256(present, _mm256_srlv_epi64(words, _mm256_and_si256(pos, _mm256_set1_epi64x(63))));
+    if (_mm256_testz_si256(present, present)) return false;
+  }
+  return true;
+}
+
+// Object IDs of objects 4k..4k+3, and which of them exist (all ones) or exist and are writes
+__attribute__((target("avx2")))
+static inline __m256i bloom_lanes_avx2(const txn_t *txn, int k, __m256i *valid, __m256i *valid_wr) {
+  const __m256i lane = _mm256_setr_epi64x(0, 1, 2, 3);
+  __m256i objs = _mm256_loadu_si256((const __m256i *)&txn->objs[4*k]);
+  *valid = _mm256_cmpgt_epi64(_mm256_set1_epi64x((long long)txn->num_objs), _mm256_add_epi64(lane, _mm256_set1_epi64x(4*k)));
+  *valid_wr = _mm256_and_si256(*valid, _mm256_cmpgt_epi64(_mm256_setzero_si256(), objs));
+  return _mm256_and_si256(objs, _mm256_set1_epi64x(~(1LL << 63)));
+}
+
+__attribute__((target("avx2")))
+static inline bool bloom_query_txn_avx2(const bloom_t *bf, const txn_t *txn) {
+  __m256i valid, valid_wr;
+  for (int k = 0; 4*k < (int)txn->num_objs; ++k) {
+    __m256i ids = bloom_lanes_avx2(txn, k, &valid, &valid_wr);
+    if (bloom_probe_avx2(bf, ids, valid)) return true;
+  }
+  return false;
+}
+
+__attribute__((target("avx2")))
+static inline bool bloom_rw_query_txn_avx2(const bloom_rw_t *bf, const txn_t *txn, bool all_writes) {
+  __m256i valid, valid_wr;
+  for (int k = 0; 4*k < (int)txn->num_objs; ++k) {
+    __m256i ids = bloom_lanes_avx2(txn, k, &valid, &valid_wr);
+    if (all_writes) valid_wr = valid;
+    // Any access against the writes, writes also against the reads, in one pass over the hashes
+    __m256i in_writes = _mm256_and_si256(valid, _mm256_set1_epi64x(1));
+    __m256i in_reads = _mm256_and_si256(valid_wr, _mm256_set1_epi64x(1));
+    bool hit = true;
+    for (int i = 0; i < BLOOM_NUM_HASHES && hit; ++i) {
+      __m256i pos = bloom_positions_avx2(ids, i);
+      __m256i word_idx = _mm256_srli_epi64(pos, 6), bit = _mm256_and_si256(pos, _mm256_set1_epi64x(63));
+      in_writes = _mm256_and_si256(in_writes, _mm256_srlv_epi64(_mm256_i64gather_epi64((const long long *)bf->writes.bits, word_idx, 8), bit));
+      in_reads = _mm256_and_si256(in_reads, _mm256_srlv_epi64(_mm256_i64gather_epi64((const long long *)bf->reads.bits, word_idx, 8), bit));
+      __m256i any = _mm256_or_si256(in_writes, in_reads);
+      hit = !_mm256_testz_si256(any, any);
+    }
+    if (hit) return true;
+  }
+  return false;
+}
+
+__attribute__((target("avx2")))
+static inline void bloom_insert_txn_avx2(bloom_t *bf, const txn_t *txn) {
+  __m256i valid, valid_wr;
+  uint64_t bitpos[BLOOM_NUM_HASHES][4];
+  for (int k = 0; 4*k < (int)txn->num_objs; ++k) {
+    __m256i ids = bloom_lanes_avx2(txn, k, &valid, &valid_wr);
+    for (int i = 0; i < BLOOM_NUM_HASHES; ++i) _mm256_storeu_si256((__m256i *)bitpos[i], bloom_positions_avx2(ids, i));
+    for (int l = 0; l < 4 && 4*k + l < (int)txn->num_objs; ++l) {
+      for (int i = 0; i < BLOOM_NUM_HASHES; ++i) bf->bits[bitpos[i][l] / 64] |= 1ull << (bitpos[i][l] % 64);
+    }
+  }
+}
+
+__attribute__((target("avx2")))
+static inline void bloom_rw_insert_txn_avx2(bloom_rw_t *bf, const txn_t *txn, bool all_writes) {
+  __m256i valid, valid_wr;
+  uint64_t bitpos[BLOOM_NUM_HASHES][4];
+  for (int k = 0; 4*k < (int)txn->num_objs; ++k) {
+    __m256i ids = bloom_lanes_avx2(txn, k, &valid, &valid_wr);
+    for (int i = 0; i < BLOOM_NUM_HASHES; ++i) _mm256_storeu_si256((__m256i *)bitpos[i], bloom_positions_avx2(ids, i));
+    for (int l = 0; l < 4 && 4*k + l < (int)txn->num_objs; ++l) {
+      bloom_t *filter = all_writes || obj_is_write(txn->objs[4*k + l]) ? &bf->writes : &bf->reads;
+      for (int i = 0; i < BLOOM_NUM_HASHES; ++i) filter->bits[bitpos[i][l] / 64] |= 1ull << (bitpos[i][l] % 64);
+    }
+  }
+}
+#endif
+
+// Whether any object of the transaction *may* be present
+static inline bool bloom_query_txn(const bloom_t *bf, const txn_t *txn) {
+#ifdef BLOOM_TXN_AVX2
+  if (__builtin_cpu_supports("avx2")) return bloom_query_txn_avx2(bf, txn);
+#endif
+  return bloom_query_txn_scalar(bf, txn);
+}
+
+static inline void bloom_insert_txn(bloom_t *bf, const txn_t *txn) {
+#ifdef BLOOM_TXN_AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    bloom_insert_txn_avx2(bf, txn);
+    return;
+  }
+#endif
+  for (int i = 0; i < (int)txn->num_objs; ++i) bloom_insert(bf, txn->objs[i] & ~(1ULL << 63));
+}
+
+// Whether the transaction *may* conflict with what was inserted
+static inline bool bloom_rw_query_txn(const bloom_rw_t *bf, const txn_t *txn, bool all_writes) {
+#ifdef BLOOM_TXN_AVX2
+  if (__builtin_cpu_supports("avx2")) return bloom_rw_query_txn_avx2(bf, txn, all_writes);
+#endif
+  return bloom_rw_query_txn_scalar(bf, txn, all_writes);
+}
+
+static inline void bloom_rw_insert_txn(bloom_rw_t *bf, const txn_t *txn, bool all_writes) {
+#ifdef BLOOM_TXN_AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    bloom_rw_insert_txn_avx2(bf, txn, all_writes);
+    return;
+  }
+#endif
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    bloom_rw_insert(bf, txn->objs[i] & ~(1ULL << 63), all_writes || obj_is_write(txn->objs[i]));
+  }
+}
+
+/*
+Blocked Bloom filter: the same bit budget cut into 64-byte blocks. One hash picks the block and
+every bit of an object lands inside it, so an insert or query touches a single cache line instead
+of one per hash function. The price is a slightly higher false-positive rate, since blocks fill
+up unevenly. No scheduling policy uses this layout yet; bloom_bench compares it to the
+partitioned one, with the scalar and the AVX2 block test.
+*/
+#define BLOOM_BLOCK_WORDS 8
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_WORDS * 64)
+#define BLOOM_NUM_BLOCKS (BLOOM_TOTAL_BITS / BLOOM_BLOCK_BITS)
+
+#if BLOOM_TOTAL_BITS % BLOOM_BLOCK_BITS != 0
+#error "BLOOM_TOTAL_BITS must be a multiple of the block size"
+#endif
+#if BLOOM_NUM_HASHES * 9 > 64
+#error "Too many hash functions for a blocked Bloom filter"
+#endif
+
+typedef struct {
+  alignas(64) uint64_t words[BLOOM_BLOCK_WORDS];
+} bloom_block_t;
+
+typedef struct {
+  bloom_block_t blocks[BLOOM_NUM_BLOCKS];
+} bloom_blocked_t;
+
+static inline uint32_t bloom_block_index(uint64_t objid) {
+  return bloom_hash(objid, 0) % BLOOM_NUM_BLOCKS;
+}
+
+// Bit positions within the block are 9-bit fields of a single product
+static inline uint64_t bloom_block_hash(uint64_t objid) {
+  return objid * 0xc6a4a7935bd1e995ull;
+}
+
+static inline uint32_t bloom_block_bit(uint64_t h, int idx) {
+  return (h >> (64 - 9 * (idx+1))) & (BLOOM_BLOCK_BITS-1);
+}
+
+static inline void bloom_blocked_init(bloom_blocked_t *bf) {
+  memset(bf, 0, sizeof(*bf));
+}
+
+static inline void bloom_blocked_insert(bloom_blocked_t *bf, uint64_t objid) {
+  bloom_block_t *block = &bf->blocks[bloom_block_index(objid)];
+  uint64_t h = bloom_block_hash(objid);
+  for (int i = 0; i < BLOOM_NUM_HASHES; ++i) {
+    uint32_t bitpos = bloom_block_bit(h, i);
+    block->words[bitpos / 64] |= 1ull << (bitpos % 64);
+  }
+}
+
+static inline bool bloom_blocked_query(const bloom_blocked_t *bf, uint64_t objid) {
+  const bloom_block_t *block = &bf->blocks[bloom_block_index(objid)];
+  uint64_t h = bloom_block_hash(objid);
+  for (int i = 0; i < BLOOM_NUM_HASHES; ++i) {
+    uint32_t bitpos = bloom_block_bit(h, i);
+    if (!(block->words[bitpos / 64] & (1ull << (bitpos % 64)))) return false;
+  }
+  return true;
+}
+
+#if BLOOM_BLOCK_WORDS == 8
+#define BLOOM_BLOCKED_AVX2 1
+
+// Same answer as bloom_blocked_query, testing the whole block at once: the object's bits are
+// spread into a 512-bit mask, which must be contained in the block. No early exit.
+__attribute__((target("avx2")))
+static inline bool bloom_blocked_query_avx2(const bloom_blocked_t *bf, uint64_t objid) {
+  const __m256i *words = (const __m256i *) bf->blocks[bloom_block_index(objid)].words;
+  uint64_t h = bloom_block_hash(objid);
+  const __m256i lo_words = _mm256_setr_epi64x(0, 1, 2, 3);
+  const __m256i hi_words = _mm256_setr_epi64x(4, 5, 6, 7);
+  __m256i lo = _mm256_setzero_si256(), hi = _mm256_setzero_si256();
+  for (int i = 0; i < BLOOM_NUM_HASHES; ++i) {
+    uint32_t bitpos = bloom_block_bit(h, i);
+    __m256i word = _mm256_set1_epi64x(bitpos / 64);
+    __m256i bit = _mm256_set1_epi64x((long long)(1ull << (bitpos % 64)));
+    lo = _mm256_or_si256(lo, _mm256_and_si256(_mm256_cmpeq_epi64(lo_words, word), bit));
+    hi = _mm256_or_si256(hi, _mm256_and_si256(_mm256_cmpeq_epi64(hi_words, word), bit));
+  }
+  // testc: whether every bit of the mask is set in the block
+  return _mm256_testc_si256(_mm256_load_si256(&words[0]), lo) &&
+         _mm256_testc_si256(_mm256_load_si256(&words[1]), hi);
+}
+#endif
+
+/*
+Counting Bloom filter: a 4-bit counter instead of each bit, so objects can be removed again
+and the summary never needs rebuilding to forget completed transactions.
+A counter that reaches 15 saturates and stays there, since it no longer knows how many
+insertions it stands for. Insert reports when that happens; such counters only cause
+false positives, until the owner rebuilds the filter from scratch.
+*/
+#define BLOOM_COUNT_MAX 15
+
+typedef struct {
+  uint64_t words[BLOOM_TOTAL_BITS / 16];
+} bloom_count_t;
+
+static inline void bloom_count_init(bloom_count_t *bf) {
+  memset(bf, 0, sizeof(*bf));
+}
+
+// Insert an object ID. Returns whether a counter saturated.
+static inline bool bloom_count_insert(bloom_count_t *bf, uint64_t objid) {
+  bool saturated = false;
+  for (int i = 0; i < BLOOM_NUM_HASHES; ++i) {
+    uint32_t pos = i * BLOOM_PART_BITS + bloom_hash(objid, i);
+    uint64_t *w = &bf->words[pos / 16];
+    int shift = (pos % 16) * 4;
+    uint64_t count = (*w >> shift) & 15;
+    if (count < BLOOM_COUNT_MAX) {
+      *w += 1ull << shift;
+      saturated |= count + 1 == BLOOM_COUNT_MAX;
+    }
+  }
+  return saturated;
+}
+
+// Remove an object ID that was inserted before
+static inline void bloom_count_remove(bloom_count_t *bf, uint64_t objid) {
+  for (int i = 0; i < BLOOM_NUM_HASHES; ++i) {
+    uint32_t pos = i * BLOOM_PART_BITS + bloom_hash(objid, i);
+    uint64_t *w = &bf->words[pos / 16];
+    int shift = (pos % 16) * 4;
+    uint64_t count = (*w >> shift) & 15;
+    if (count < BLOOM_COUNT_MAX) *w -= 1ull << shift;
+  }
+}
+
+static inline bool bloom_count_query(const bloom_count_t *bf, uint64_t objid) {
+  for (int i = 0; i < BLOOM_NUM_HASHES; ++i) {
+    uint32_t pos = i * BLOOM_PART_BITS + bloom_hash(objid, i);
+    if (!((bf->words[pos / 16] >> ((pos % 16) * 4)) & 15)) return false;
+  }
+  return true;
+}
+
+// Reader/writer split of counting filters, see bloom_rw_t
+typedef struct {
+  bloom_count_t reads;
+  bloom_count_t writes;
+} bloom_count_rw_t;
+
+static inline void bloom_count_rw_init(bloom_count_rw_t *bf) {
+  bloom_count_init(&bf->reads);
+  bloom_count_init(&bf->writes);
+}
+
+static inline bool bloom_count_rw_insert(bloom_count_rw_t *bf, uint64_t objid, bool write) {
+  return bloom_count_insert(write ? &bf->writes : &bf->reads, objid);
+}
+
+static inline void bloom_count_rw_remove(bloom_count_rw_t *bf, uint64_t objid, bool write) {
+  bloom_count_remove(write ? &bf->writes : &bf->reads, objid);
+}
+
+static inline bool bloom_count_rw_query(const bloom_count_rw_t *bf, uint64_t objid, bool write) {
+  return bloom_count_query(&bf->writes, objid) || (write && bloom_count_query(&bf->reads, objid));
+}
+
 #ifdef __cplusplus
 }
 #endif
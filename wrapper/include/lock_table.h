@@ -0,0 +1,140 @@
+// lock_table.h - Exact per-object lock table for conflict checking
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "pmhw.h"
+#include "pmutils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+Open-addressing hash table keyed by object ID (without the read/write bit).
+Each entry tracks how many active transactions read the object and whether one writes it.
+Entries are removed as soon as they become unused, using backward-shift deletion,
+so there are no tombstones and probe sequences stay short.
+
+A transaction may list an object more than once. Repeated reads each count as a reader,
+repeated writes take and drop the writer flag once.
+*/
+typedef struct {
+  obj_id_t obj;
+  uint32_t readers;
+  bool writer;
+} lock_entry_t;
+
+typedef struct {
+  lock_entry_t *entries;
+  int capacity;
+  int mask;
+  int size;
+} lock_table_t;
+
+static inline bool lock_entry_used(const lock_entry_t *e) {
+  return e->readers != 0 || e->writer;
+}
+
+static inline int lock_table_home(const lock_table_t *lt, obj_id_t obj) {
+  return (int)((obj * 0x9e3779b97f4a7c15ull) >> 32) & lt->mask;
+}
+
+// Capacity must be a power of two and should be at least twice the number of tracked objects
+static inline void lock_table_init(lock_table_t *lt, int capacity) {
+  ASSERT((capacity & (capacity-1)) == 0);
+  lt->entries = (lock_entry_t *) calloc(capacity, sizeof(lock_entry_t));
+  ASSERT(lt->entries);
+  lt->capacity = capacity;
+  lt->mask = capacity-1;
+  lt->size = 0;
+}
+
+static inline void lock_table_free(lock_table_t *lt) {
+  free(lt->entries);
+  lt->entries = NULL;
+  lt->capacity = 0;
+  lt->size = 0;
+}
+
+// Return the slot holding obj, or the empty slot where it would be inserted
+static inline int lock_table_find(const lock_table_t *lt, obj_id_t obj) {
+  int i = lock_table_home(lt, obj);
+  while (lock_entry_used(&lt->entries[i]) && lt->entries[i].obj != obj) {
+    i = (i+1) & lt->mask;
+  }
+  return i;
+}
+
+// Remove the entry at slot i, shifting back later entries of the same probe run
+static inline void lock_table_erase(lock_table_t *lt, int i) {
+  int j = i;
+  while (true) {
+    j = (j+1) & lt->mask;
+    if (!lock_entry_used(&lt->entries[j])) break;
+    int home = lock_table_home(lt, lt->entries[j].obj);
+    // Move entry j into the hole only if its home does not lie cyclically in (i, j]
+    bool in_range = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+    if (!in_range) {
+      lt->entries[i] = lt->entries[j];
+      i = j;
+    }
+  }
+  lt->entries[i] = (lock_entry_t){ 0, 0, false };
+  lt->size--;
+}
+
+// Whether the write at objs[i] repeats an earlier one of the same transaction
+static inline bool lock_write_repeated(const txn_t *txn, int i) {
+  for (int j = 0; j < i; ++j) {
+    if (txn->objs[j] == txn->objs[i]) return true;
+  }
+  return false;
+}
+
+// Return true if the transaction conflicts with any lock currently held
+static inline bool lock_table_check(const lock_table_t *lt, const txn_t *txn) {
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    obj_id_t obj = txn->objs[i] & ~(1ULL << 63);
+    const lock_entry_t *e = &lt->entries[lock_table_find(lt, obj)];
+    if (!lock_entry_used(e)) continue;
+    if (e->writer || obj_is_write(txn->objs[i])) return true; // RW or WW conflict
+  }
+  return false;
+}
+
+// Take all locks of a transaction. Caller must have checked that there is no conflict.
+static inline void lock_table_acquire(lock_table_t *lt, const txn_t *txn) {
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    if (obj_is_write(txn->objs[i]) && lock_write_repeated(txn, i)) continue;
+    obj_id_t obj = txn->objs[i] & ~(1ULL << 63);
+    lock_entry_t *e = &lt->entries[lock_table_find(lt, obj)];
+    if (!lock_entry_used(e)) {
+      ASSERTF(lt->size < lt->capacity - 1, "Lock table is full");
+      e->obj = obj;
+      lt->size++;
+    }
+    if (obj_is_write(txn->objs[i])) e->writer = true;
+    else e->readers++;
+  }
+}
+
+// Release all locks of a previously acquired transaction
+static inline void lock_table_release(lock_table_t *lt, const txn_t *txn) {
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    if (obj_is_write(txn->objs[i]) && lock_write_repeated(txn, i)) continue;
+    obj_id_t obj = txn->objs[i] & ~(1ULL << 63);
+    int slot = lock_table_find(lt, obj);
+    lock_entry_t *e = &lt->entries[slot];
+    ASSERT(lock_entry_used(e));
+    if (obj_is_write(txn->objs[i])) e->writer = false;
+    else e->readers--;
+    if (!lock_entry_used(e)) lock_table_erase(lt, slot);
+  }
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,6 +2,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <immintrin.h>
 #include "pmutils.h"
 
 #ifdef __cplusplus
@@ -9,13 +10,11 @@ extern "C" {
 #endif
 
 /*
-Supported sizes
+Default sizes, used by pmhw_init. pmhw_init_ex takes them from pmhw_config_t instead.
 */
-#define MAX_CLIENTS 1
-#define MAX_PUPPETS 16
-#define SCHEDULER_CORE_ID 0
-#define MAX_PENDING_PER_CLIENT 32
-#define MAX_ACTIVE_PER_PUPPET 32
+#define PMHW_DEF_SCHEDULER_CORE 0
+#define PMHW_DEF_PENDING_PER_CLIENT 32
+#define PMHW_DEF_ACTIVE_PER_PUPPET 32
 
 /*
 Maximum number of objects per transaction
@@ -41,7 +40,7 @@ static inline void obj_set_rw(obj_id_t *id, bool write) {
 }
 
 /*
-Puppetmaster transaction descriptor
+Puppetmaster transaction descriptor. An object may be listed more than once, e.g. read and written.
 */
 typedef uint64_t txn_id_t;
 typedef uint64_t aux_data_t;
@@ -53,8 +52,26 @@ typedef struct {
   char _pad[(64*4 - sizeof(txn_id_t) - sizeof(aux_data_t) - sizeof(size_t) - sizeof(obj_id_t)*MAX_TXN_OBJS) % 64];
 } txn_t;
 
-// Helper function
-static inline bool check_txn_conflict(const txn_t *a, const txn_t *b) {
+/*
+Descriptor as laid out in a submission queue, used by the zero-copy path.
+Same fields as txn_t without the padding, so only the first num_objs objects are ever touched.
+*/
+typedef struct {
+  txn_id_t id;
+  aux_data_t aux_data;
+  uint64_t num_objs;
+  obj_id_t objs[MAX_TXN_OBJS];
+} packed_txn_t;
+
+/*
+Conflict check between two transactions.
+check_txn_conflict picks a kernel the CPU supports at runtime; the others are exposed for benchmarking.
+The vector kernels compare one object of a against all MAX_TXN_OBJS slots of b at once,
+masking out slots past b->num_objs.
+AVX-512 measured slower than AVX2 on the machines we tried (see bin/conflict_bench),
+so it is only preferred when built with -DPMHW_CONFLICT_AVX512.
+*/
+static inline bool check_txn_conflict_scalar(const txn_t *a, const txn_t *b) {
   for (int i = 0; i < (int)a->num_objs; i++) {
     obj_id_t obj_a = a->objs[i] & ~(1ULL << 63);
     bool wr_a      = obj_is_write(a->objs[i]);
@@ -69,6 +86,71 @@ static inline bool check_txn_conflict(const txn_t *a, const txn_t *b) {
   }
   return false;
 }
+
+#if MAX_TXN_OBJS == 16
+__attribute__((target("avx2")))
+static inline bool check_txn_conflict_avx2(const txn_t *a, const txn_t *b) {
+  const __m256i id_mask = _mm256_set1_epi64x(~(1LL << 63));
+  const __m256i lane = _mm256_setr_epi64x(0, 1, 2, 3);
+  const __m256i num_b = _mm256_set1_epi64x((long long)b->num_objs);
+
+  // For every slot of b: its object ID, whether it is valid, and whether it is a valid write
+  __m256i ids[4], valid[4], valid_wr[4];
+  for (int k = 0; k < 4; ++k) {
+    __m256i objs = _mm256_loadu_si256((const __m256i *)&b->objs[4*k]);
+    ids[k] = _mm256_and_si256(objs, id_mask);
+    valid[k] = _mm256_cmpgt_epi64(num_b, _mm256_add_epi64(lane, _mm256_set1_epi64x(4*k)));
+    valid_wr[k] = _mm256_and_si256(valid[k], _mm256_cmpgt_epi64(_mm256_setzero_si256(), objs));
+  }
+
+  for (int i = 0; i < (int)a->num_objs; i++) {
+    __m256i obj_a = _mm256_set1_epi64x((long long)(a->objs[i] & ~(1ULL << 63)));
+    // A write in a conflicts with any access in b, a read only with writes
+    const __m256i *sel = obj_is_write(a->objs[i]) ? valid : valid_wr;
+    __m256i hit = _mm256_or_si256(
+      _mm256_or_si256(_mm256_and_si256(_mm256_cmpeq_epi64(obj_a, ids[0]), sel[0]),
+                      _mm256_and_si256(_mm256_cmpeq_epi64(obj_a, ids[1]), sel[1])),
+      _mm256_or_si256(_mm256_and_si256(_mm256_cmpeq_epi64(obj_a, ids[2]), sel[2]),
+                      _mm256_and_si256(_mm256_cmpeq_epi64(obj_a, ids[3]), sel[3])));
+    if (!_mm256_testz_si256(hit, hit)) return true;
+  }
+  return false;
+}
+
+__attribute__((target("avx512f")))
+static inline bool check_txn_conflict_avx512(const txn_t *a, const txn_t *b) {
+  const __m512i id_mask = _mm512_set1_epi64(~(1LL << 63));
+  __m512i objs_lo = _mm512_loadu_si512((const void *)&b->objs[0]);
+  __m512i objs_hi = _mm512_loadu_si512((const void *)&b->objs[8]);
+  __m512i ids_lo = _mm512_and_si512(objs_lo, id_mask);
+  __m512i ids_hi = _mm512_and_si512(objs_hi, id_mask);
+
+  // Lane masks of valid slots in b, and of valid slots that are writes
+  uint16_t valid = (uint16_t)((1u << b->num_objs) - 1);
+  __mmask8 valid_lo = (__mmask8)valid, valid_hi = (__mmask8)(valid >> 8);
+  __mmask8 wr_lo = _mm512_mask_cmplt_epi64_mask(valid_lo, objs_lo, _mm512_setzero_si512());
+  __mmask8 wr_hi = _mm512_mask_cmplt_epi64_mask(valid_hi, objs_hi, _mm512_setzero_si512());
+
+  for (int i = 0; i < (int)a->num_objs; i++) {
+    __m512i obj_a = _mm512_set1_epi64((long long)(a->objs[i] & ~(1ULL << 63)));
+    bool wr_a = obj_is_write(a->objs[i]);
+    __mmask8 hit = _mm512_mask_cmpeq_epi64_mask(wr_a ? valid_lo : wr_lo, obj_a, ids_lo)
+                 | _mm512_mask_cmpeq_epi64_mask(wr_a ? valid_hi : wr_hi, obj_a, ids_hi);
+    if (hit) return true;
+  }
+  return false;
+}
+#endif
+
+static inline bool check_txn_conflict(const txn_t *a, const txn_t *b) {
+#if MAX_TXN_OBJS == 16
+#ifdef PMHW_CONFLICT_AVX512
+  if (__builtin_cpu_supports("avx512f")) return check_txn_conflict_avx512(a, b);
+#endif
+  if (__builtin_cpu_supports("avx2")) return check_txn_conflict_avx2(a, b);
+#endif
+  return check_txn_conflict_scalar(a, b);
+}
 static inline void dump_txn(FILE *f, const txn_t *txn) {
   fprintf(f, "txn_t(id=%ld, aux_data=%ld, num_objs=%ld, reads={", txn->id, txn->aux_data, txn->num_objs);
   for (int i = 0; i < (int)txn->num_objs; ++i) {
@@ -85,6 +167,61 @@ static inline void dump_txn(FILE *f, const txn_t *txn) {
   fprintf(f, "}\n");
 }
 
+/*
+How the scheduler picks a puppet for each scheduled transaction.
+Only meaningful for the software backends; the hardware does its own assignment.
+*/
+typedef enum {
+  PMHW_DISPATCH_ROUND_ROBIN  = 0,  /* strict round robin, stalls on a saturated puppet */
+  PMHW_DISPATCH_LEAST_LOADED = 1,  /* puppet with the fewest in-flight transactions */
+  PMHW_DISPATCH_AFFINITY     = 2   /* puppet that last ran the transaction's objects, unless it is much busier
+                                      than the least loaded one, so object data stays in its caches */
+} pmhw_dispatch_t;
+
+/*
+How threads wait on Puppetmaster queues, e.g. a puppet with no work or a client facing a full queue.
+Only meaningful for the software backends.
+*/
+typedef enum {
+  PMHW_WAIT_SPIN  = 0,  /* busy-poll, lowest latency, burns a core per thread */
+  PMHW_WAIT_PAUSE = 1,  /* busy-poll with a pause instruction between attempts */
+  PMHW_WAIT_SLEEP = 2   /* spin for a while, then sleep on a futex until woken up */
+} pmhw_wait_t;
+
+/*
+Runtime configuration. Sizes and the scheduler core only apply to the software backends.
+*/
+typedef struct {
+  int num_clients;
+  int num_puppets;
+  int pending_per_client;   /* transactions each client's submission queue holds at least */
+  int active_per_puppet;    /* transactions a puppet may have in flight */
+  int scheduler_core;       /* core the scheduler thread is pinned to, -1 to leave it unpinned */
+  pmhw_dispatch_t dispatch;
+  pmhw_wait_t wait;
+  const char *policy;       /* scheduling policy of the software backends, NULL for $PMHW_POLICY or the default */
+  bool work_stealing;       /* software backends: idle puppets take transactions queued for busy ones */
+  int num_shards;           /* software backends: scheduler threads, each owning a slice of the objects and puppets */
+} pmhw_config_t;
+
+/*
+Configuration with default sizes and policies for the given number of clients and puppets
+*/
+static inline pmhw_config_t pmhw_config_default(int num_clients, int num_puppets) {
+  pmhw_config_t config;
+  config.num_clients        = num_clients;
+  config.num_puppets        = num_puppets;
+  config.pending_per_client = PMHW_DEF_PENDING_PER_CLIENT;
+  config.active_per_puppet  = PMHW_DEF_ACTIVE_PER_PUPPET;
+  config.scheduler_core     = PMHW_DEF_SCHEDULER_CORE;
+  config.dispatch           = PMHW_DISPATCH_ROUND_ROBIN;
+  config.wait               = PMHW_WAIT_SPIN;
+  config.policy             = NULL;
+  config.work_stealing      = false;
+  config.num_shards         = 1;
+  return config;
+}
+
 /*
 Interfaces
 */
@@ -94,8 +231,15 @@ Initialize Puppetmaster. Must be called before any other operations.
 */
 void pmhw_init(int num_clients, int num_puppets);
 
+/*
+Initialize Puppetmaster with an explicit configuration, e.g. one from pmhw_config_default
+with some fields changed. Equivalent to pmhw_init otherwise.
+*/
+void pmhw_init_ex(const pmhw_config_t *config);
+
 /*
 Clean up Puppetmaster.
+Threads blocked in a Puppetmaster call return once it shuts down; poll calls then report no transaction.
 */
 void pmhw_shutdown();
 
@@ -104,19 +248,142 @@ Submit a new transaction descriptor to Puppetmaster.
 */
 void pmhw_schedule(int client_id, const txn_t *txn);
 
+/*
+Outcome of a non-blocking submission
+*/
+typedef enum {
+  PMHW_ACCEPTED   = 0,  /* queued for scheduling */
+  PMHW_QUEUE_FULL = 1,  /* the client's submission queue has no room, nothing was queued */
+  PMHW_SHUT_DOWN  = 2,  /* Puppetmaster is not running, nothing was queued */
+  PMHW_UNSUPPORTED = 3  /* the backend cannot tell whether there is room, nothing was queued; use pmhw_schedule */
+} pmhw_status_t;
+
+/*
+Submit a transaction descriptor if the client's queue has room, without ever waiting,
+so the caller can do other work, shed load or measure how long it waits for room itself.
+*/
+pmhw_status_t pmhw_try_schedule(int client_id, const txn_t *txn);
+
+/*
+Number of transactions a client has submitted that the scheduler has not taken off its queue yet,
+i.e. that are still queueing rather than being scheduled. Safe to call from any thread.
+Returns -1 if the backend cannot tell, in which case pmhw_try_schedule is unsupported too.
+*/
+int pmhw_queue_depth(int client_id);
+
+/*
+Zero-copy submission. pmhw_reserve_txn returns space for one descriptor directly in the client's queue,
+blocking until there is room, or NULL if Puppetmaster is shutting down. The caller fills in id, aux_data,
+num_objs and objs, then publishes it with pmhw_commit_txn. A client holds at most one reservation
+at a time and must commit it before calling pmhw_schedule or pmhw_schedule_batch.
+*/
+packed_txn_t *pmhw_reserve_txn(int client_id);
+void pmhw_commit_txn(int client_id, packed_txn_t *txn);
+
 /*
 Poll for a scheduled transaction assigned to a puppet.
 If a transaction becomes ready, fills in transactionId and puppetId.
 Return false if found no transaction.
+With work stealing, the transaction may have been scheduled for another puppet;
+report it done from this puppet as usual.
 */
 bool pmhw_poll_scheduled(int puppet_id, txn_id_t *txn_id);
 
 /*
 Report that a previously assigned transaction has been completed by a puppet.
 This signals the scheduler that the puppet is now idle and ready for new work.
+With the software backends, a puppet may have several transactions in flight
+and complete them in any order.
 */
 void pmhw_report_done(int puppet_id, txn_id_t txn_id);
 
+/*
+Batched variants of the calls above. Each moves many descriptors or IDs per call
+and publishes them to the scheduler with a single queue index update.
+*/
+
+/*
+Submit n transaction descriptors. Blocks until all of them have been accepted.
+*/
+void pmhw_schedule_batch(int client_id, const txn_t *txns, int n);
+
+/*
+Poll for up to max transactions assigned to a puppet and store their IDs in txn_ids.
+Returns the number of IDs stored, which is 0 only if Puppetmaster is shutting down.
+*/
+int pmhw_poll_scheduled_batch(int puppet_id, txn_id_t *txn_ids, int max);
+
+/*
+Report that n previously assigned transactions have been completed by a puppet.
+*/
+void pmhw_report_done_batch(int puppet_id, const txn_id_t *txn_ids, int n);
+
+/*
+Optimistic scheduling (the "optimistic" policy of the software backends) dispatches without
+checking for conflicts and validates transactions when they complete instead. A transaction that
+fails validation is aborted: it does not count as committed, and its ID is handed back to the client
+that submitted it, which must submit it again.
+
+Poll for up to max aborted transactions of a client and store their IDs in txn_ids.
+Does not block. Returns the number of IDs stored. Aborts wait inside Puppetmaster until polled.
+*/
+int pmhw_poll_aborted(int client_id, txn_id_t *txn_ids, int max);
+
+/*
+Counters since pmhw_init, safe to read at any time
+*/
+typedef struct {
+  uint64_t num_committed;   /* completions that count, i.e. all but the aborted ones */
+  uint64_t num_aborted;     /* completions that failed validation */
+
+  /* Bloom summary policies: held-back transactions checked against the exact active set
+     (estimated from a sample, see SIM_BLOOM_FP_SAMPLE_SHIFT), split into real conflicts and false positives */
+  uint64_t num_summary_checked;
+  uint64_t num_true_conflicts;
+  uint64_t num_false_positives;
+
+  uint64_t num_cross_shard; /* sharded software scheduler: transactions admitted by more than one shard */
+
+  double elapsed;           /* seconds since pmhw_init, up to pmhw_shutdown, to turn counts into rates */
+} pmhw_stats_t;
+
+void pmhw_get_stats(pmhw_stats_t *stats);
+
+/*
+Scheduler contexts. A context is an independent Puppetmaster instance with its own queues and,
+on the software backends, its own scheduler thread, e.g. one per NUMA node or per shard of the
+object space. Client and puppet IDs count from 0 within each context; the event log (pmlog.h)
+is shared by all of them. Each call above has a pmhw_ctx_ variant taking the context first.
+The calls without one work on a default context, which pmhw_init creates and the next
+pmhw_init frees. The hardware backend supports a single context.
+*/
+typedef struct pmhw_ctx pmhw_ctx_t;
+
+// Create and start a context
+pmhw_ctx_t *pmhw_ctx_create(const pmhw_config_t *config);
+
+// Stop a context. Threads blocked in one of its calls return, as with pmhw_shutdown.
+void pmhw_ctx_shutdown(pmhw_ctx_t *ctx);
+
+// Release a stopped context once no thread is inside one of its calls any more
+void pmhw_ctx_free(pmhw_ctx_t *ctx);
+
+// The context the calls without one work on, NULL before the first pmhw_init
+pmhw_ctx_t *pmhw_default_ctx();
+
+void pmhw_ctx_schedule(pmhw_ctx_t *ctx, int client_id, const txn_t *txn);
+pmhw_status_t pmhw_ctx_try_schedule(pmhw_ctx_t *ctx, int client_id, const txn_t *txn);
+int pmhw_ctx_queue_depth(pmhw_ctx_t *ctx, int client_id);
+packed_txn_t *pmhw_ctx_reserve_txn(pmhw_ctx_t *ctx, int client_id);
+void pmhw_ctx_commit_txn(pmhw_ctx_t *ctx, int client_id, packed_txn_t *txn);
+bool pmhw_ctx_poll_scheduled(pmhw_ctx_t *ctx, int puppet_id, txn_id_t *txn_id);
+void pmhw_ctx_report_done(pmhw_ctx_t *ctx, int puppet_id, txn_id_t txn_id);
+void pmhw_ctx_schedule_batch(pmhw_ctx_t *ctx, int client_id, const txn_t *txns, int n);
+int pmhw_ctx_poll_scheduled_batch(pmhw_ctx_t *ctx, int puppet_id, txn_id_t *txn_ids, int max);
+void pmhw_ctx_report_done_batch(pmhw_ctx_t *ctx, int puppet_id, const txn_id_t *txn_ids, int n);
+int pmhw_ctx_poll_aborted(pmhw_ctx_t *ctx, int client_id, txn_id_t *txn_ids, int max);
+void pmhw_ctx_get_stats(pmhw_ctx_t *ctx, pmhw_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
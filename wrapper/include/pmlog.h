@@ -22,13 +22,17 @@ note we're not logging the time it takes to report work-done back to the hardwar
 
 handled by users: PMLOG_SUBMIT, PMLOG_WORK_RECV, PMLOG_DONE
 handled by puppetmaster hardware/wrapper: PMLOG_INPUT_RECV, PMLOG_SCHED_READY
+
+An aborted txn (optimistic scheduling) gets PMLOG_ABORT instead of PMLOG_CLEANUP,
+and the events of its next attempt follow.
 */
 typedef enum {
   PMLOG_SUBMIT         = 0,  /* client starts trying to submit txn     */
   PMLOG_SCHED_READY    = 1,  /* hardware scheduled the txn             */
   PMLOG_WORK_RECV      = 2,  /* client got txn work request            */
   PMLOG_DONE           = 3,  /* puppet finished processing             */
-  PMLOG_CLEANUP        = 4   /* puppet finished processing             */
+  PMLOG_CLEANUP        = 4,  /* puppet finished processing             */
+  PMLOG_ABORT          = 5   /* completed txn failed validation        */
 } pmlog_kind_t;
 
 typedef struct {
@@ -41,6 +45,8 @@ typedef struct {
 void pmlog_init(int max_num_events, int sample_period, FILE *live_print);
 void pmlog_cleanup();
 void pmlog_record(txn_id_t txn_id, pmlog_kind_t kind, uint64_t aux_data);
+// Same event for n transactions handled together, e.g. by a batch call: one timestamp and one slot reservation
+void pmlog_record_batch(const txn_id_t *txn_ids, int n, pmlog_kind_t kind, uint64_t aux_data);
 
 void pmlog_start_timer(double cpu_freq);
 void pmlog_write(FILE *f);
@@ -0,0 +1,111 @@
+// pmwait.h - Wait strategies for threads blocked on Puppetmaster queues
+#pragma once
+
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <x86intrin.h>
+
+#include "pmhw.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Failed attempts before a PMHW_WAIT_SLEEP waiter goes to sleep
+#ifndef PMWAIT_SPIN_LIMIT
+#define PMWAIT_SPIN_LIMIT 1024
+#endif
+
+// Upper bound on a single sleep, so sleepers also notice shutdown without a wakeup
+#ifndef PMWAIT_SLEEP_NS
+#define PMWAIT_SLEEP_NS 1000000
+#endif
+
+/*
+Something a thread can sleep on, e.g. "this queue got new items".
+Producers call pmwait_notify after publishing. A notify costs one fence and,
+only if someone is actually asleep, a futex wake.
+*/
+typedef struct {
+  alignas(64) atomic_uint seq;
+  atomic_int waiters;
+  char _pad[64 - sizeof(atomic_uint) - sizeof(atomic_int)];
+} pmwait_event_t;
+
+static inline void pmwait_init(pmwait_event_t *ev) {
+  atomic_init(&ev->seq, 0);
+  atomic_init(&ev->waiters, 0);
+}
+
+// Back off between two failed attempts while still spinning
+static inline void pmwait_relax(pmhw_wait_t strategy) {
+  if (strategy != PMHW_WAIT_SPIN) _mm_pause();
+}
+
+// Wake every sleeper regardless of whether they appear to be waiting
+static inline void pmwait_wake_all(pmwait_event_t *ev) {
+  atomic_fetch_add_explicit(&ev->seq, 1, memory_order_release);
+  syscall(SYS_futex, &ev->seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+// Called by the producer after publishing new items
+static inline void pmwait_notify(pmhw_wait_t strategy, pmwait_event_t *ev) {
+  if (strategy != PMHW_WAIT_SLEEP) return;
+  // Order the publish before reading waiters; pairs with the increment in pmwait_prepare
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&ev->waiters, memory_order_relaxed) > 0) {
+    pmwait_wake_all(ev);
+  }
+}
+
+/*
+Sleeping takes three steps so no wakeup gets lost:
+pmwait_prepare registers the waiter and returns a ticket, the caller re-checks its condition,
+and only then pmwait_sleep blocks unless something was published after the ticket was taken.
+pmwait_finish must follow every pmwait_prepare.
+*/
+static inline unsigned pmwait_prepare(pmwait_event_t *ev) {
+  atomic_fetch_add_explicit(&ev->waiters, 1, memory_order_seq_cst);
+  return atomic_load_explicit(&ev->seq, memory_order_acquire);
+}
+
+static inline void pmwait_sleep(pmwait_event_t *ev, unsigned ticket) {
+  struct timespec timeout = { 0, PMWAIT_SLEEP_NS };
+  syscall(SYS_futex, &ev->seq, FUTEX_WAIT_PRIVATE, ticket, &timeout, NULL, 0);
+}
+
+static inline void pmwait_finish(pmwait_event_t *ev) {
+  atomic_fetch_sub_explicit(&ev->waiters, 1, memory_order_relaxed);
+}
+
+/*
+Evaluate cond until it holds, waiting according to strategy in between.
+cond may have side effects (e.g. a dequeue) only when it returns true.
+Evaluates to false if *running became false before cond held.
+*/
+#define PMWAIT_UNTIL(strategy, ev, running, cond) __extension__ ({ \
+  bool _pmwait_ok = true; \
+  for (int _pmwait_spins = 0; !(cond); ++_pmwait_spins) { \
+    if (!atomic_load_explicit((running), memory_order_relaxed)) { _pmwait_ok = false; break; } \
+    if ((strategy) != PMHW_WAIT_SLEEP || _pmwait_spins < PMWAIT_SPIN_LIMIT) { \
+      pmwait_relax(strategy); \
+      continue; \
+    } \
+    unsigned _pmwait_ticket = pmwait_prepare(ev); \
+    bool _pmwait_ready = (cond); \
+    if (!_pmwait_ready) pmwait_sleep((ev), _pmwait_ticket); \
+    pmwait_finish(ev); \
+    if (_pmwait_ready) break; \
+  } \
+  _pmwait_ok; \
+})
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,86 @@
+// sim_policy.h - Scheduling policies of the software backend
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "pmhw.h"
+#include "active_set.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+Counters a policy may add to on the scheduler thread, readable at any time through pmhw_get_stats
+*/
+typedef struct {
+  atomic_uint_fast64_t num_summary_checked;   // held-back transactions checked against the exact active set, scaled up from a sample
+  atomic_uint_fast64_t num_false_positives;   // of those, the ones that did not actually conflict
+} sim_counters_t;
+
+/*
+Scheduler state a policy may look at but not change, except for the counters.
+When the scheduler is sharded, each shard has its own policy state and only shows it its own objects.
+*/
+typedef struct {
+  sim_counters_t *counters;
+  const active_set_t *active;   // scheduled transactions that have not completed yet
+  const int *num_inflight;      // active transactions per puppet
+  int num_clients;              // input queues windowed, i.e. clients plus, when sharded, lower shards forwarding here
+  int num_puppets;
+  int active_per_puppet;
+} sim_view_t;
+
+/*
+A scheduling policy. The scheduler keeps a window of `window` pending transactions per client,
+offers them to admit() oldest first, and dispatches the admitted ones to puppets.
+Hooks marked optional may be NULL.
+*/
+typedef struct {
+  const char *name;
+  int window;       // pending transactions per client considered out of order, 1 = in order
+  int max_bypass;   // younger transactions admitted ahead of a held-back one before it blocks its window
+
+  void *(*create)(const sim_view_t *view);
+  void (*destroy)(void *state);
+
+  // Optional: called once per scheduling pass with every windowed transaction in priority order,
+  // for policies that decide on whole batches
+  void (*begin_pass)(void *state, const txn_t *const *candidates, int n);
+
+  // Whether a transaction may run alongside everything active now
+  bool (*admit)(void *state, const txn_t *txn);
+
+  // Optional: a transaction was held back for the first time
+  void (*on_stall)(void *state, const txn_t *txn);
+
+  // A transaction was admitted and dispatched, or completed and left the active set
+  void (*on_schedule)(void *state, const txn_t *txn);
+  void (*on_complete)(void *state, const txn_t *txn);
+
+  // Optional: whether a completed transaction, still in the active set, may commit.
+  // If not, it is aborted and handed back to its client. on_complete follows either way.
+  bool (*validate)(void *state, const txn_t *txn);
+
+  // Optional: puppet for the next admitted transaction, or -1 if none can take it.
+  // Defaults to the dispatch policy in pmhw_config_t.
+  int (*pick_puppet)(void *state, int rr_puppet_id);
+
+  // Optional: log policy-specific statistics on shutdown
+  void (*report)(void *state);
+} sim_policy_t;
+
+/*
+Look up a policy by name, NULL if there is none
+*/
+const sim_policy_t *sim_policy_find(const char *name);
+
+/*
+Comma-separated names of all policies, for error messages
+*/
+const char *sim_policy_names();
+
+#ifdef __cplusplus
+}
+#endif
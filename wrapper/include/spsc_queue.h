@@ -18,11 +18,13 @@ extern "C" {
 #define SPSC_CAT(a, b) _SPSC_CAT(a, b)
 
 // ========== Core Template ==========
+// Head and tail run freely and are masked on access, so a stale index cannot
+// be mistaken for a current one until 2^32 operations later.
 #define SPSC_NO_LOG 
 #define SPSC_QUEUE_IMPL(DATATYPE, PREFIX, TYPENAME) \
 typedef struct { \
-    alignas(64) atomic_int head; char _pad1[64-sizeof(atomic_int)]; \
-    alignas(64) atomic_int tail; char _pad2[64-sizeof(atomic_int)]; \
+    alignas(64) atomic_uint head; char _pad1[64-sizeof(atomic_uint)]; \
+    alignas(64) atomic_uint tail; char _pad2[64-sizeof(atomic_uint)]; \
     DATATYPE *buffer; int capacity; int mask; \
     char _pad[64 - sizeof(DATATYPE*) - sizeof(int)*2]; \
 } TYPENAME; \
@@ -43,46 +45,96 @@ static inline void SPSC_CAT(PREFIX, _free)(TYPENAME *q) { \
 } \
 \
 static inline bool SPSC_CAT(PREFIX, _enq)(TYPENAME *q, const DATATYPE *item) { \
-  int tail = atomic_load_explicit(&q->tail, memory_order_relaxed); \
-  int next_tail = (tail + 1) & q->mask; \
-  int head = atomic_load_explicit(&q->head, memory_order_acquire); \
-  if (next_tail == head) { \
+  unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed); \
+  unsigned head = atomic_load_explicit(&q->head, memory_order_acquire); \
+  if (tail - head == (unsigned)q->mask) { \
       return false; /* full */ \
   } \
-  q->buffer[tail] = *item; \
-  atomic_store_explicit(&q->tail, next_tail, memory_order_release); \
+  q->buffer[tail & q->mask] = *item; \
+  atomic_store_explicit(&q->tail, tail + 1, memory_order_release); \
   return true; \
 } \
 \
 static inline bool SPSC_CAT(PREFIX, _full)(TYPENAME *q) { \
-  int tail = atomic_load_explicit(&q->tail, memory_order_relaxed); \
-  int next_tail = (tail + 1) & q->mask; \
-  int head = atomic_load_explicit(&q->head, memory_order_acquire); \
-  if (next_tail == head) { \
-      return true; /* full */ \
-  } \
-  return false; \
+  unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed); \
+  unsigned head = atomic_load_explicit(&q->head, memory_order_acquire); \
+  return tail - head == (unsigned)q->mask; \
+} \
+\
+/* Number of queued items, exact only when called by the producer or a single consumer */ \
+static inline int SPSC_CAT(PREFIX, _size)(TYPENAME *q) { \
+  unsigned head = atomic_load_explicit(&q->head, memory_order_acquire); \
+  unsigned tail = atomic_load_explicit(&q->tail, memory_order_acquire); \
+  return (int)(tail - head); \
 } \
 \
 static inline bool SPSC_CAT(PREFIX, _peek)(TYPENAME *q, DATATYPE *item) { \
-  int head = atomic_load_explicit(&q->head, memory_order_relaxed); \
-  int tail = atomic_load_explicit(&q->tail, memory_order_acquire); \
+  unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed); \
+  unsigned tail = atomic_load_explicit(&q->tail, memory_order_acquire); \
   if (head == tail) { \
       return false; /* empty */ \
   } \
-  *item = q->buffer[head]; \
+  *item = q->buffer[head & q->mask]; \
   return true; \
 } \
 \
 static inline bool SPSC_CAT(PREFIX, _deq)(TYPENAME *q, DATATYPE *item) { \
-  int head = atomic_load_explicit(&q->head, memory_order_relaxed); \
-  int tail = atomic_load_explicit(&q->tail, memory_order_acquire); \
+  unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed); \
+  unsigned tail = atomic_load_explicit(&q->tail, memory_order_acquire); \
   if (head == tail) { \
       return false; /* empty */ \
   } \
-  *item = q->buffer[head]; \
-  atomic_store_explicit(&q->head, (head + 1) & q->mask, memory_order_release); \
+  *item = q->buffer[head & q->mask]; \
+  atomic_store_explicit(&q->head, head + 1, memory_order_release); \
   return true; \
+} \
+\
+/* Enqueue up to n items with a single index publish. Returns the number enqueued. */ \
+static inline int SPSC_CAT(PREFIX, _enq_batch)(TYPENAME *q, const DATATYPE *items, int n) { \
+  unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed); \
+  unsigned head = atomic_load_explicit(&q->head, memory_order_acquire); \
+  int space = q->mask - (int)(tail - head); \
+  if (n > space) n = space; \
+  for (int i = 0; i < n; ++i) { \
+      q->buffer[(tail + i) & q->mask] = items[i]; \
+  } \
+  if (n > 0) atomic_store_explicit(&q->tail, tail + n, memory_order_release); \
+  return n; \
+} \
+\
+/* Dequeue up to max items with a single index publish. Returns the number dequeued. */ \
+static inline int SPSC_CAT(PREFIX, _deq_batch)(TYPENAME *q, DATATYPE *items, int max) { \
+  unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed); \
+  unsigned tail = atomic_load_explicit(&q->tail, memory_order_acquire); \
+  int n = (int)(tail - head); \
+  if (n > max) n = max; \
+  for (int i = 0; i < n; ++i) { \
+      items[i] = q->buffer[(head + i) & q->mask]; \
+  } \
+  if (n > 0) atomic_store_explicit(&q->head, head + n, memory_order_release); \
+  return n; \
+} \
+\
+/* \
+Dequeue up to max items while other consumers may do the same, e.g. thieves taking work. \
+Items are copied out first and claimed by moving head, so the copy of a consumer that \
+loses the race is thrown away. Once a queue has several consumers, all of them must use this. \
+*/ \
+static inline int SPSC_CAT(PREFIX, _deq_batch_mc)(TYPENAME *q, DATATYPE *items, int max) { \
+  unsigned head = atomic_load_explicit(&q->head, memory_order_acquire); \
+  for (;;) { \
+    unsigned tail = atomic_load_explicit(&q->tail, memory_order_acquire); \
+    int n = (int)(tail - head); \
+    if (n <= 0) return 0; /* empty */ \
+    if (n > max) n = max; \
+    for (int i = 0; i < n; ++i) { \
+        items[i] = q->buffer[(head + i) & q->mask]; \
+    } \
+    if (atomic_compare_exchange_weak_explicit(&q->head, &head, head + n, \
+                                              memory_order_acq_rel, memory_order_acquire)) { \
+      return n; \
+    } \
+  } \
 }
 
 #ifdef __cplusplus
@@ -0,0 +1,195 @@
+// txn_ring.h - SPSC ring of variable-length transaction descriptors
+#pragma once
+
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pmhw.h"
+#include "pmutils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+A txn_t is four cache lines no matter how many objects it has. This ring stores
+only the used part: a 3-word header (id, aux_data, num_objs) followed by the objects,
+packed into consecutive cache lines, i.e. a packed_txn_t cut short after num_objs.
+Up to 5 objects fit into a single line, up to 13 into two.
+Head and tail count lines, and an entry may wrap around the end. Next to each, the side that owns it
+counts entries, so anyone can tell how many transactions are queued (txn_ring_size).
+
+For in-place writes (txn_ring_reserve/txn_ring_commit), the buffer has TXN_RING_MAX_LINES-1
+spare lines past the end, so a reserved entry is always contiguous. On commit, whatever
+spilled into the spare lines is copied to the start of the ring, where readers expect it.
+*/
+#define TXN_RING_HEADER_WORDS 3
+#define TXN_RING_LINE_WORDS 8
+
+typedef struct {
+  alignas(64) uint64_t words[TXN_RING_LINE_WORDS];
+} txn_line_t;
+
+typedef struct {
+  alignas(64) atomic_int head; atomic_uint num_deq; char _pad1[64-sizeof(atomic_int)-sizeof(atomic_uint)];
+  alignas(64) atomic_int tail; atomic_uint num_enq; char _pad2[64-sizeof(atomic_int)-sizeof(atomic_uint)];
+  txn_line_t *lines; int capacity; int mask;
+  char _pad[64 - sizeof(txn_line_t*) - sizeof(int)*2];
+} txn_ring_t;
+
+// Number of lines an entry with num_objs objects occupies
+static inline int txn_ring_lines(size_t num_objs) {
+  return (int)((TXN_RING_HEADER_WORDS + num_objs + TXN_RING_LINE_WORDS-1) / TXN_RING_LINE_WORDS);
+}
+#define TXN_RING_MAX_LINES ((TXN_RING_HEADER_WORDS + MAX_TXN_OBJS + TXN_RING_LINE_WORDS-1) / TXN_RING_LINE_WORDS)
+
+// Capacity is in lines and must be a power of two
+static inline void txn_ring_init(txn_ring_t *q, int capacity) {
+  ASSERT((capacity & (capacity-1)) == 0 && capacity > TXN_RING_MAX_LINES);
+  q->lines = (txn_line_t *) aligned_alloc(64, sizeof(txn_line_t) * (capacity + TXN_RING_MAX_LINES-1));
+  ASSERT(q->lines);
+  q->capacity = capacity;
+  q->mask = capacity-1;
+  atomic_init(&q->head, 0);
+  atomic_init(&q->tail, 0);
+  atomic_init(&q->num_deq, 0);
+  atomic_init(&q->num_enq, 0);
+}
+
+static inline void txn_ring_free(txn_ring_t *q) {
+  free(q->lines);
+  q->lines = NULL;
+  q->capacity = 0;
+}
+
+// Copy a transaction into the lines starting at pos, touching only the words it uses
+static inline void txn_ring_write(txn_ring_t *q, int pos, const txn_t *txn) {
+  int n = (int)txn->num_objs;
+  uint64_t *w = q->lines[pos].words;
+  w[0] = txn->id;
+  w[1] = txn->aux_data;
+  w[2] = txn->num_objs;
+  int i = 0;
+  for (int k = TXN_RING_HEADER_WORDS; k < TXN_RING_LINE_WORDS && i < n; ++k) w[k] = txn->objs[i++];
+  while (i < n) {
+    pos = (pos + 1) & q->mask;
+    w = q->lines[pos].words;
+    for (int k = 0; k < TXN_RING_LINE_WORDS && i < n; ++k) w[k] = txn->objs[i++];
+  }
+}
+
+// Expand the entry starting at pos into a txn_t, leaving unused object slots untouched.
+// Returns the number of lines the entry occupies.
+static inline int txn_ring_read(const txn_ring_t *q, int pos, txn_t *txn) {
+  const uint64_t *w = q->lines[pos].words;
+  int n = (int)w[2];
+  txn->id = w[0];
+  txn->aux_data = w[1];
+  txn->num_objs = n;
+  int i = 0;
+  for (int k = TXN_RING_HEADER_WORDS; k < TXN_RING_LINE_WORDS && i < n; ++k) txn->objs[i++] = w[k];
+  while (i < n) {
+    pos = (pos + 1) & q->mask;
+    w = q->lines[pos].words;
+    for (int k = 0; k < TXN_RING_LINE_WORDS && i < n; ++k) txn->objs[i++] = w[k];
+  }
+  return txn_ring_lines(n);
+}
+
+// Entry counts only change on their owner's side; the head/tail publish orders them for txn_ring_size
+static inline void txn_ring_count_enq(txn_ring_t *q, unsigned n) {
+  atomic_store_explicit(&q->num_enq, atomic_load_explicit(&q->num_enq, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// Free lines, from the producer's side
+static inline int txn_ring_space(const txn_ring_t *q) {
+  int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  int head = atomic_load_explicit(&q->head, memory_order_acquire);
+  return (head - tail - 1) & q->mask;
+}
+
+// Number of transactions queued, safe to call from any thread. A snapshot that may already be stale.
+static inline int txn_ring_size(const txn_ring_t *q) {
+  unsigned deq = atomic_load_explicit(&q->num_deq, memory_order_acquire);
+  unsigned enq = atomic_load_explicit(&q->num_enq, memory_order_relaxed);
+  return (int)(enq - deq);
+}
+
+static inline bool txn_ring_enq(txn_ring_t *q, const txn_t *txn) {
+  ASSERT(txn->num_objs <= MAX_TXN_OBJS);
+  int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  int space = txn_ring_space(q);
+  int lines = txn_ring_lines(txn->num_objs);
+  if (lines > space) {
+    return false; /* full */
+  }
+  txn_ring_write(q, tail, txn);
+  txn_ring_count_enq(q, 1);
+  atomic_store_explicit(&q->tail, (tail + lines) & q->mask, memory_order_release);
+  return true;
+}
+
+// Enqueue up to n transactions with a single index publish. Returns the number enqueued.
+static inline int txn_ring_enq_batch(txn_ring_t *q, const txn_t *txns, int n) {
+  int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  int head = atomic_load_explicit(&q->head, memory_order_acquire);
+  int space = (head - tail - 1) & q->mask;
+  int i = 0;
+  for (; i < n; ++i) {
+    ASSERT(txns[i].num_objs <= MAX_TXN_OBJS);
+    int lines = txn_ring_lines(txns[i].num_objs);
+    if (lines > space) break;
+    txn_ring_write(q, tail, &txns[i]);
+    tail = (tail + lines) & q->mask;
+    space -= lines;
+  }
+  if (i > 0) {
+    txn_ring_count_enq(q, i);
+    atomic_store_explicit(&q->tail, tail, memory_order_release);
+  }
+  return i;
+}
+
+// Space for one entry of up to MAX_TXN_OBJS objects at the tail, or NULL if full.
+// Nothing becomes visible to the consumer until txn_ring_commit.
+static inline packed_txn_t *txn_ring_reserve(txn_ring_t *q) {
+  _Static_assert(sizeof(packed_txn_t) <= TXN_RING_MAX_LINES * sizeof(txn_line_t), "packed_txn_t does not fit");
+  int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  int head = atomic_load_explicit(&q->head, memory_order_acquire);
+  int space = (head - tail - 1) & q->mask;
+  if (space < TXN_RING_MAX_LINES) {
+    return NULL; /* full */
+  }
+  return (packed_txn_t *) &q->lines[tail];
+}
+
+// Publish the entry returned by the last txn_ring_reserve
+static inline void txn_ring_commit(txn_ring_t *q, packed_txn_t *txn) {
+  ASSERT(txn->num_objs <= MAX_TXN_OBJS);
+  int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  ASSERT((txn_line_t *) txn == &q->lines[tail]);
+  int lines = txn_ring_lines(txn->num_objs);
+  // Move lines that spilled into the spare area to the start of the ring
+  for (int i = q->capacity; i < tail + lines; ++i) q->lines[i - q->capacity] = q->lines[i];
+  txn_ring_count_enq(q, 1);
+  atomic_store_explicit(&q->tail, (tail + lines) & q->mask, memory_order_release);
+}
+
+static inline bool txn_ring_deq(txn_ring_t *q, txn_t *txn) {
+  int head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  int tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+  if (head == tail) {
+    return false; /* empty */
+  }
+  int lines = txn_ring_read(q, head, txn);
+  atomic_store_explicit(&q->head, (head + lines) & q->mask, memory_order_release);
+  atomic_store_explicit(&q->num_deq, atomic_load_explicit(&q->num_deq, memory_order_relaxed) + 1, memory_order_release);
+  return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
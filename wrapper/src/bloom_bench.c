@@ -0,0 +1,405 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <x86intrin.h>
+
+#include "pmhw.h"
+#include "bloom.h"
+
+#define NUM_TRIALS 256
+#define NUM_CANDIDATES 1024
+#define BENCH_MAX_OBJS 8
+#define NUM_CHURN_STEPS 65536
+#define NUM_QUERIES 65536
+#define NUM_COLD_FILTERS 1024
+
+// Read-heavy to write-heavy mixes, and in-flight transactions the summary covers
+int write_percents[] = {50, 20, 5, 0};
+int active_sizes[] = {32, 256};
+int key_counts[] = {256, 1024, 4096, 8192};
+uint64_t pool_sizes[] = {1024, 65536};
+// Completions per main/shadow swap: what matters is how many transactions finish within one refresh
+// period, a few at the sim's default SIM_BLOOM_REFRESH_NS up to one per check in the hardware
+int refresh_periods[] = {4, 64};
+const int NUM_WRITE_PERCENTS = sizeof(write_percents) / sizeof(write_percents[0]);
+const int NUM_ACTIVE_SIZES = sizeof(active_sizes) / sizeof(active_sizes[0]);
+const int NUM_POOLS = sizeof(pool_sizes) / sizeof(pool_sizes[0]);
+const int NUM_KEY_COUNTS = sizeof(key_counts) / sizeof(key_counts[0]);
+const int NUM_REFRESH_PERIODS = sizeof(refresh_periods) / sizeof(refresh_periods[0]);
+
+static uint64_t rng_state = 88172645463325252ull;
+static uint64_t rng() {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+// Transactions shaped like the generated workloads: 1 to BENCH_MAX_OBJS distinct objects
+static void make_txn(txn_t *txn, uint64_t pool, int write_percent) {
+  txn->num_objs = 1 + rng() % BENCH_MAX_OBJS;
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    obj_id_t obj;
+    bool dup;
+    do {
+      obj = rng() % pool;
+      dup = false;
+      for (int j = 0; j < i; ++j) dup |= (txn->objs[j] & ~(1ULL << 63)) == obj;
+    } while (dup);
+    obj_set_rw(&obj, (int)(rng() % 100) < write_percent);
+    txn->objs[i] = obj;
+  }
+}
+
+// Summarize like checkOrAddToChunk in Summary.bsv: every access counts as a potential conflict
+static void unified_add(bloom_t *bf, const txn_t *txn) {
+  for (int i = 0; i < (int)txn->num_objs; ++i) bloom_insert(bf, txn->objs[i] & ~(1ULL << 63));
+}
+
+static bool unified_check(const bloom_t *bf, const txn_t *txn) {
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    if (bloom_query(bf, txn->objs[i] & ~(1ULL << 63))) return true;
+  }
+  return false;
+}
+
+static void split_add(bloom_rw_t *bf, const txn_t *txn) {
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    bloom_rw_insert(bf, txn->objs[i] & ~(1ULL << 63), obj_is_write(txn->objs[i]));
+  }
+}
+
+static bool split_check(const bloom_rw_t *bf, const txn_t *txn) {
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    if (bloom_rw_query(bf, txn->objs[i] & ~(1ULL << 63), obj_is_write(txn->objs[i]))) return true;
+  }
+  return false;
+}
+
+static void counting_add(bloom_count_rw_t *bf, const txn_t *txn) {
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    bloom_count_rw_insert(bf, txn->objs[i] & ~(1ULL << 63), obj_is_write(txn->objs[i]));
+  }
+}
+
+static void counting_remove(bloom_count_rw_t *bf, const txn_t *txn) {
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    bloom_count_rw_remove(bf, txn->objs[i] & ~(1ULL << 63), obj_is_write(txn->objs[i]));
+  }
+}
+
+static bool counting_check(const bloom_count_rw_t *bf, const txn_t *txn) {
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    if (bloom_count_rw_query(bf, txn->objs[i] & ~(1ULL << 63), obj_is_write(txn->objs[i]))) return true;
+  }
+  return false;
+}
+
+// Summary of every active transaction except the one in slot skip
+static void split_rebuild(bloom_rw_t *bf, const txn_t *active, int n, int skip) {
+  bloom_rw_init(bf);
+  for (int i = 0; i < n; ++i) {
+    if (i != skip) split_add(bf, &active[i]);
+  }
+}
+
+/*
+Steady state like the sim scheduler: each step the oldest active transaction completes and
+one candidate is offered. The refresh scheme works like the bloom policy and the hardware:
+completed transactions stay in the summaries, and every period steps the shadow becomes the main
+summary, the old main one gets refilled from the active list, and candidates are refused for the
+hardware's share of the period spent switching (24 of 512 cycles), rounded to whole steps.
+The counting scheme removes completed transactions right away.
+*/
+static void churn(bloom_rw_t *split, bloom_rw_t *shadow, bloom_count_rw_t *counting, txn_t *active, uint64_t pool, int num_active, int write_percent, int period) {
+  int swap_stall = (period * 24 + 256) / 512;
+  txn_t candidate;
+  uint64_t refresh_ok = 0, counting_ok = 0, num_refused = 0;
+  uint64_t refresh_cycles = 0, counting_cycles = 0;
+
+  // Refresh scheme
+  uint64_t saved_rng = rng_state;
+  for (int i = 0; i < num_active; ++i) make_txn(&active[i], pool, write_percent);
+  split_rebuild(split, active, num_active, -1);
+  split_rebuild(shadow, active, num_active, -1);
+  int oldest = 0, until_swap = period, stall = 0;
+  for (int step = 0; step < NUM_CHURN_STEPS; ++step) {
+    make_txn(&candidate, pool, write_percent);
+    uint64_t start = __rdtsc();
+    bool swapped = --until_swap <= 0;
+    if (swapped) {
+      bloom_rw_t *tmp = split;
+      split = shadow;
+      shadow = tmp;
+      split_rebuild(shadow, active, num_active, oldest);
+      until_swap = period;
+      stall = swap_stall;
+    }
+    bool hit = stall > 0 || split_check(split, &candidate);
+    num_refused += stall > 0;
+    stall -= stall > 0;
+    if (!hit) {
+      split_add(split, &candidate);
+      split_add(shadow, &candidate);
+    } else if (swapped) {
+      // A held-back candidate leaves the completed transaction in place, keeping the list full
+      split_add(shadow, &active[oldest]);
+    }
+    refresh_cycles += __rdtsc() - start;
+    if (!hit) active[oldest] = candidate;
+    refresh_ok += !hit;
+    oldest = (oldest + 1) % num_active;
+  }
+
+  // Counting scheme, on the same transactions
+  rng_state = saved_rng;
+  for (int i = 0; i < num_active; ++i) make_txn(&active[i], pool, write_percent);
+  bloom_count_rw_init(counting);
+  for (int i = 0; i < num_active; ++i) counting_add(counting, &active[i]);
+  oldest = 0;
+  for (int step = 0; step < NUM_CHURN_STEPS; ++step) {
+    make_txn(&candidate, pool, write_percent);
+    uint64_t start = __rdtsc();
+    counting_remove(counting, &active[oldest]);
+    bool hit = counting_check(counting, &candidate);
+    counting_add(counting, hit ? &active[oldest] : &candidate);
+    counting_cycles += __rdtsc() - start;
+    if (!hit) active[oldest] = candidate;
+    counting_ok += !hit;
+    oldest = (oldest + 1) % num_active;
+  }
+
+  printf("%-8lu %-7d %-7d %-7d %9.2f%% %9.2f%% %9.2f%% %14.2f %14.2f\n",
+         pool, num_active, write_percent, period,
+         100.0 * refresh_ok / NUM_CHURN_STEPS, 100.0 * counting_ok / NUM_CHURN_STEPS, 100.0 * num_refused / NUM_CHURN_STEPS,
+         (double)refresh_cycles / NUM_CHURN_STEPS, (double)counting_cycles / NUM_CHURN_STEPS);
+}
+
+/*
+Partitioned against blocked layout at the same bit budget. False positives are measured on keys
+never inserted. Lookups are timed on one filter that stays in cache, and round-robin over
+NUM_COLD_FILTERS filters with the same contents at different addresses, where probes miss.
+Absent keys usually stop at the first probe, inserted ones (a conflict) take all of them.
+*/
+static void fill_layouts(bloom_t *parts, bloom_blocked_t *blocked, uint64_t *keys, uint64_t *members, int num_keys) {
+  for (int f = 0; f < NUM_COLD_FILTERS; ++f) {
+    bloom_init(&parts[f]);
+    bloom_blocked_init(&blocked[f]);
+  }
+  for (int i = 0; i < num_keys; ++i) {
+    members[i] = rng() >> 1;
+    bloom_insert(&parts[0], members[i]);
+    bloom_blocked_insert(&blocked[0], members[i]);
+  }
+  for (int f = 1; f < NUM_COLD_FILTERS; ++f) {
+    parts[f] = parts[0];
+    blocked[f] = blocked[0];
+  }
+  // Inserted keys are below 2^63, so these are all absent
+  for (int q = 0; q < NUM_QUERIES; ++q) keys[q] = rng() | (1ULL << 63);
+}
+
+static void layouts(bloom_t *parts, bloom_blocked_t *blocked, uint64_t *keys, uint64_t *members, int num_keys) {
+  fill_layouts(parts, blocked, keys, members, num_keys);
+
+  uint64_t parts_fp = 0, blocked_fp = 0;
+  uint64_t start = __rdtsc();
+  for (int q = 0; q < NUM_QUERIES; ++q) parts_fp += bloom_query(&parts[0], keys[q]);
+  uint64_t parts_hot = __rdtsc() - start;
+  start = __rdtsc();
+  for (int q = 0; q < NUM_QUERIES; ++q) blocked_fp += bloom_blocked_query(&blocked[0], keys[q]);
+  uint64_t blocked_hot = __rdtsc() - start;
+
+  uint64_t hits = 0;
+  start = __rdtsc();
+  for (int q = 0; q < NUM_QUERIES; ++q) hits += bloom_query(&parts[q % NUM_COLD_FILTERS], keys[q]);
+  uint64_t parts_cold = __rdtsc() - start;
+  start = __rdtsc();
+  for (int q = 0; q < NUM_QUERIES; ++q) hits += bloom_blocked_query(&blocked[q % NUM_COLD_FILTERS], keys[q]);
+  uint64_t blocked_cold = __rdtsc() - start;
+  start = __rdtsc();
+  for (int q = 0; q < NUM_QUERIES; ++q) hits += bloom_query(&parts[q % NUM_COLD_FILTERS], members[q % num_keys]);
+  uint64_t parts_member = __rdtsc() - start;
+  start = __rdtsc();
+  for (int q = 0; q < NUM_QUERIES; ++q) hits += bloom_blocked_query(&blocked[q % NUM_COLD_FILTERS], members[q % num_keys]);
+  uint64_t blocked_member = __rdtsc() - start;
+  __asm__ volatile("" :: "r"(hits));
+
+  printf("%-7d %-9.1f %9.3f%% %9.3f%% %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+         num_keys, (double)BLOOM_TOTAL_BITS / num_keys,
+         100.0 * parts_fp / NUM_QUERIES, 100.0 * blocked_fp / NUM_QUERIES,
+         (double)parts_hot / NUM_QUERIES, (double)blocked_hot / NUM_QUERIES,
+         (double)parts_cold / NUM_QUERIES, (double)blocked_cold / NUM_QUERIES,
+         (double)parts_member / NUM_QUERIES, (double)blocked_member / NUM_QUERIES);
+}
+
+#ifdef BLOOM_BLOCKED_AVX2
+/*
+Scalar block test with early exit against the AVX2 whole-block test, on the same filters as
+layouts(). Returns false if they ever disagree.
+*/
+static bool blocked_simd(bloom_t *parts, bloom_blocked_t *blocked, uint64_t *keys, uint64_t *members, int num_keys) {
+  fill_layouts(parts, blocked, keys, members, num_keys);
+  for (int q = 0; q < NUM_QUERIES; ++q) {
+    if (bloom_blocked_query(&blocked[0], keys[q]) != bloom_blocked_query_avx2(&blocked[0], keys[q]) ||
+        !bloom_blocked_query_avx2(&blocked[0], members[q % num_keys])) {
+      return false;
+    }
+  }
+
+  uint64_t hits = 0, cycles[6];
+  for (int v = 0; v < 6; ++v) {
+    bool avx2 = v % 2;
+    uint64_t start = __rdtsc();
+    for (int q = 0; q < NUM_QUERIES; ++q) {
+      const bloom_blocked_t *bf = v < 2 ? &blocked[0] : &blocked[q % NUM_COLD_FILTERS];
+      uint64_t key = v < 4 ? keys[q] : members[q % num_keys];
+      hits += avx2 ? bloom_blocked_query_avx2(bf, key) : bloom_blocked_query(bf, key);
+    }
+    cycles[v] = __rdtsc() - start;
+  }
+  __asm__ volatile("" :: "r"(hits));
+
+  printf("%-7d %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n", num_keys,
+         (double)cycles[0] / NUM_QUERIES, (double)cycles[1] / NUM_QUERIES,
+         (double)cycles[2] / NUM_QUERIES, (double)cycles[3] / NUM_QUERIES,
+         (double)cycles[4] / NUM_QUERIES, (double)cycles[5] / NUM_QUERIES);
+  return true;
+}
+#endif
+
+int main() {
+  txn_t *active = aligned_alloc(64, sizeof(txn_t) * active_sizes[NUM_ACTIVE_SIZES-1]);
+  txn_t *candidates = aligned_alloc(64, sizeof(txn_t) * NUM_CANDIDATES);
+  bloom_t *unified = aligned_alloc(64, sizeof(bloom_t));
+  bloom_rw_t *split = aligned_alloc(64, sizeof(bloom_rw_t));
+  bloom_rw_t *shadow = aligned_alloc(64, sizeof(bloom_rw_t));
+  bloom_count_rw_t *counting = aligned_alloc(64, sizeof(bloom_count_rw_t));
+  bloom_t *unified_txn = aligned_alloc(64, sizeof(bloom_t));
+  bloom_rw_t *split_txn = aligned_alloc(64, sizeof(bloom_rw_t));
+  bloom_t *parts = aligned_alloc(64, sizeof(bloom_t) * NUM_COLD_FILTERS);
+  bloom_blocked_t *blocked = aligned_alloc(64, sizeof(bloom_blocked_t) * NUM_COLD_FILTERS);
+  uint64_t *keys = malloc(sizeof(uint64_t) * (NUM_QUERIES + key_counts[NUM_KEY_COUNTS-1]));
+  if (!active || !candidates || !unified || !split || !shadow || !counting || !unified_txn || !split_txn || !parts || !blocked || !keys) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+
+  // A candidate is admitted if the summary of the active transactions shows no conflict.
+  // Exact is what check_txn_conflict allows; the gap to it is concurrency lost to the summary.
+  printf("%-8s %-7s %-7s %10s %10s %10s %14s %14s %14s\n", "Pool", "Active", "Write%",
+         "Exact", "Unified", "Split", "Unified cyc", "Split cyc", "Split txn cyc");
+  for (int p = 0; p < NUM_POOLS; ++p) {
+    for (int a = 0; a < NUM_ACTIVE_SIZES; ++a) {
+      for (int w = 0; w < NUM_WRITE_PERCENTS; ++w) {
+        uint64_t exact_ok = 0, unified_ok = 0, split_ok = 0;
+        uint64_t unified_cycles = 0, split_cycles = 0, txn_cycles = 0;
+        for (int t = 0; t < NUM_TRIALS; ++t) {
+          bloom_init(unified);
+          bloom_rw_init(split);
+          bloom_init(unified_txn);
+          bloom_rw_init(split_txn);
+          for (int i = 0; i < active_sizes[a]; ++i) {
+            make_txn(&active[i], pool_sizes[p], write_percents[w]);
+            unified_add(unified, &active[i]);
+            split_add(split, &active[i]);
+            bloom_insert_txn(unified_txn, &active[i]);
+            bloom_rw_insert_txn(split_txn, &active[i], false);
+          }
+          if (memcmp(unified, unified_txn, sizeof(bloom_t)) || memcmp(split, split_txn, sizeof(bloom_rw_t))) {
+            fprintf(stderr, "Whole-transaction insert disagrees with per-object inserts\n");
+            return 1;
+          }
+          for (int c = 0; c < NUM_CANDIDATES; ++c) make_txn(&candidates[c], pool_sizes[p], write_percents[w]);
+
+          for (int c = 0; c < NUM_CANDIDATES; ++c) {
+            bool conflict = false;
+            for (int i = 0; i < active_sizes[a] && !conflict; ++i) conflict = check_txn_conflict(&candidates[c], &active[i]);
+            bool unified_hit = unified_check(unified, &candidates[c]);
+            bool split_hit = split_check(split, &candidates[c]);
+            // Summaries may only err towards conflicts
+            if (conflict && (!unified_hit || !split_hit)) {
+              fprintf(stderr, "Summary missed a conflict\n");
+              return 1;
+            }
+            if (bloom_query_txn(unified, &candidates[c]) != unified_hit ||
+                bloom_rw_query_txn(split, &candidates[c], false) != split_hit) {
+              fprintf(stderr, "Whole-transaction query disagrees with per-object queries\n");
+              return 1;
+            }
+            exact_ok += !conflict;
+            unified_ok += !unified_hit;
+            split_ok += !split_hit;
+          }
+
+          uint64_t hits = 0;
+          uint64_t start = __rdtsc();
+          for (int c = 0; c < NUM_CANDIDATES; ++c) hits += unified_check(unified, &candidates[c]);
+          unified_cycles += __rdtsc() - start;
+          start = __rdtsc();
+          for (int c = 0; c < NUM_CANDIDATES; ++c) hits += split_check(split, &candidates[c]);
+          split_cycles += __rdtsc() - start;
+          start = __rdtsc();
+          for (int c = 0; c < NUM_CANDIDATES; ++c) hits += bloom_rw_query_txn(split, &candidates[c], false);
+          txn_cycles += __rdtsc() - start;
+          __asm__ volatile("" :: "r"(hits));
+        }
+
+        double total = (double)NUM_TRIALS * NUM_CANDIDATES;
+        printf("%-8lu %-7d %-7d %9.2f%% %9.2f%% %9.2f%% %14.2f %14.2f %14.2f\n",
+               pool_sizes[p], active_sizes[a], write_percents[w],
+               100.0 * exact_ok / total, 100.0 * unified_ok / total, 100.0 * split_ok / total,
+               unified_cycles / total, split_cycles / total, txn_cycles / total);
+      }
+    }
+  }
+
+  // Forgetting completed transactions: periodic main/shadow swaps against a counting filter.
+  // Refresh counts the candidates admitted, Swap stall those refused only because a swap was in progress.
+  printf("\n%-8s %-7s %-7s %-7s %10s %10s %10s %14s %14s\n", "Pool", "Active", "Write%", "Period",
+         "Refresh", "Counting", "Swap stall", "Refresh cyc", "Counting cyc");
+  for (int p = 0; p < NUM_POOLS; ++p) {
+    for (int a = 0; a < NUM_ACTIVE_SIZES; ++a) {
+      for (int w = 0; w < NUM_WRITE_PERCENTS; ++w) {
+        for (int r = 0; r < NUM_REFRESH_PERIODS; ++r) {
+          churn(split, shadow, counting, active, pool_sizes[p], active_sizes[a], write_percents[w], refresh_periods[r]);
+        }
+      }
+    }
+  }
+
+  // Filter layouts at the same bit budget, per lookup of an absent key
+  printf("\n%-7s %-9s %10s %10s %10s %10s %10s %10s %10s %10s\n", "Keys", "Bits/key",
+         "Part FP", "Block FP", "Part hot", "Block hot", "Part cold", "Block cold", "Part hit", "Block hit");
+  for (int k = 0; k < NUM_KEY_COUNTS; ++k) layouts(parts, blocked, keys, keys + NUM_QUERIES, key_counts[k]);
+
+#ifdef BLOOM_BLOCKED_AVX2
+  // Blocked layout: scalar early-exit test against the AVX2 whole-block test
+  if (__builtin_cpu_supports("avx2")) {
+    printf("\n%-7s %10s %10s %10s %10s %10s %10s\n", "Keys",
+           "Block hot", "AVX2 hot", "Block cold", "AVX2 cold", "Block hit", "AVX2 hit");
+    for (int k = 0; k < NUM_KEY_COUNTS; ++k) {
+      if (!blocked_simd(parts, blocked, keys, keys + NUM_QUERIES, key_counts[k])) {
+        fprintf(stderr, "AVX2 block test disagrees with the scalar one\n");
+        return 1;
+      }
+    }
+  }
+#endif
+
+  free(active);
+  free(candidates);
+  free(unified);
+  free(split);
+  free(shadow);
+  free(counting);
+  free(unified_txn);
+  free(split_txn);
+  free(parts);
+  free(blocked);
+  free(keys);
+  return 0;
+}
@@ -0,0 +1,111 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <x86intrin.h>
+
+#include "pmhw.h"
+
+#define NUM_TXNS 4096
+#define NUM_PAIRS (1 << 22)
+#define WRITE_PERCENT 50
+
+// Object pool sizes, from heavily contended to practically conflict-free
+uint64_t pool_sizes[] = {64, 1024, 65536, 1ull << 40};
+const int NUM_POOLS = sizeof(pool_sizes) / sizeof(pool_sizes[0]);
+
+typedef bool (*conflict_fn)(const txn_t *, const txn_t *);
+
+typedef struct {
+  const char *name;
+  conflict_fn fn;
+  bool supported;
+} Kernel;
+
+static uint64_t rng_state = 88172645463325252ull;
+static uint64_t rng() {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+// Transactions shaped like the generated workloads: 1 to MAX_TXN_OBJS distinct objects, mixed reads and writes
+static void make_txns(txn_t *txns, uint64_t pool) {
+  for (int t = 0; t < NUM_TXNS; ++t) {
+    memset(&txns[t], 0, sizeof(txn_t));
+    txns[t].id = t;
+    txns[t].num_objs = 1 + rng() % MAX_TXN_OBJS;
+    for (int i = 0; i < (int)txns[t].num_objs; ++i) {
+      obj_id_t obj;
+      bool dup;
+      do {
+        obj = rng() % pool;
+        dup = false;
+        for (int j = 0; j < i; ++j) dup |= (txns[t].objs[j] & ~(1ULL << 63)) == obj;
+      } while (dup);
+      obj_set_rw(&obj, rng() % 100 < WRITE_PERCENT);
+      txns[t].objs[i] = obj;
+    }
+    // Leftover slots hold garbage, as they may in real descriptors
+    for (int i = txns[t].num_objs; i < MAX_TXN_OBJS; ++i) txns[t].objs[i] = rng();
+  }
+}
+
+int main() {
+  Kernel kernels[] = {
+    {"scalar", check_txn_conflict_scalar, true},
+#if MAX_TXN_OBJS == 16
+    {"avx2", check_txn_conflict_avx2, __builtin_cpu_supports("avx2")},
+    {"avx512", check_txn_conflict_avx512, __builtin_cpu_supports("avx512f")},
+#endif
+    {"dispatch", check_txn_conflict, true},
+  };
+  const int NUM_KERNELS = sizeof(kernels) / sizeof(kernels[0]);
+
+  txn_t *txns = aligned_alloc(64, sizeof(txn_t) * NUM_TXNS);
+  uint32_t *pairs = malloc(sizeof(uint32_t) * 2 * NUM_PAIRS);
+  if (!txns || !pairs) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+
+  printf("%-14s %-10s %12s %14s\n", "Pool", "Kernel", "Conflicts", "Cycles/check");
+  for (int p = 0; p < NUM_POOLS; ++p) {
+    make_txns(txns, pool_sizes[p]);
+    for (int i = 0; i < 2 * NUM_PAIRS; ++i) pairs[i] = rng() % NUM_TXNS;
+
+    for (int k = 0; k < NUM_KERNELS; ++k) {
+      if (!kernels[k].supported) {
+        printf("%-14lu %-10s %12s %14s\n", pool_sizes[p], kernels[k].name, "-", "unsupported");
+        continue;
+      }
+
+      // Every kernel must agree with the scalar reference on every pair, in both orders
+      for (int i = 0; i < NUM_PAIRS; ++i) {
+        const txn_t *a = &txns[pairs[2*i]], *b = &txns[pairs[2*i+1]];
+        if (kernels[k].fn(a, b) != check_txn_conflict_scalar(a, b) ||
+            kernels[k].fn(b, a) != check_txn_conflict_scalar(b, a)) {
+          fprintf(stderr, "%s disagrees with scalar on txns %lu and %lu\n", kernels[k].name, a->id, b->id);
+          return 1;
+        }
+      }
+
+      uint64_t conflicts = 0;
+      uint64_t start = __rdtsc();
+      for (int i = 0; i < NUM_PAIRS; ++i) {
+        conflicts += kernels[k].fn(&txns[pairs[2*i]], &txns[pairs[2*i+1]]);
+      }
+      uint64_t cycles = __rdtsc() - start;
+
+      printf("%-14lu %-10s %12lu %14.2f\n", pool_sizes[p], kernels[k].name, conflicts,
+             (double)cycles / NUM_PAIRS);
+    }
+  }
+
+  free(txns);
+  free(pairs);
+  return 0;
+}
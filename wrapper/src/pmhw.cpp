@@ -1,6 +1,9 @@
+#include <atomic>
+#include <chrono>
 #include <queue>
 #include <mutex>
 #include <condition_variable>
+#include <vector>
 
 #include "pmhw.h"
 #include "pmutils.h"
@@ -39,26 +42,50 @@ public:
 
 class WorkIndication : public WorkIndicationWrapper {
 public:
-  std::queue<WorkMessage> msgs;
+  std::vector<std::queue<WorkMessage>> msgs; // per puppet
   std::mutex mutex;
+  std::condition_variable cv;
+  bool stopped = false;
   void startWork(WorkMessage m) {
     // DEBUG_LOG("T#" << m.tid << " scheduled on cycle " << m.cycle << " for P#" << m.pid);
     std::unique_lock guard(mutex);
-    msgs.push(m);
+    msgs[m.pid].push(m);
+    cv.notify_all();
   }
-  WorkIndication(int id) : WorkIndicationWrapper(id), msgs(), mutex() {}
+  // Blocks until the puppet has work or Puppetmaster shuts down, then takes up to max messages at once
+  int take(int puppet_id, txn_id_t *txn_ids, int max) {
+    std::unique_lock guard(mutex);
+    auto &q = msgs[puppet_id];
+    cv.wait(guard, [&] { return !q.empty() || stopped; });
+    int n = 0;
+    for (; n < max && !q.empty(); ++n) {
+      txn_ids[n] = q.front().tid;
+      q.pop();
+    }
+    return n;
+  }
+  void stop() {
+    std::unique_lock guard(mutex);
+    stopped = true;
+    cv.notify_all();
+  }
+  WorkIndication(int id, int num_puppets) : WorkIndicationWrapper(id), msgs(num_puppets), mutex(), cv() {}
 };
 
 /*
-Singleton representing active Puppetmaster instance
+Singleton representing active Puppetmaster instance. There is one FPGA, so it is the only context.
 */
-static struct pmhw_singleton_t {
+static struct pmhw_ctx {
   bool initialized = false;
   std::unique_ptr<HostSetupRequestProxy> setup = nullptr;
   std::unique_ptr<HostTxnRequestProxy> txn = nullptr;
   std::unique_ptr<HostWorkDoneProxy> workDone = nullptr;
   std::unique_ptr<DebugIndication> debugInd = nullptr;
   std::unique_ptr<WorkIndication> workInd = nullptr;
+  std::vector<packed_txn_t> reserved; // per-client scratch space for pmhw_reserve_txn
+  std::atomic<uint64_t> num_committed{0}; // completions reported by puppets
+  std::chrono::steady_clock::time_point init_time, shutdown_time;
+  bool shut_down = false;
 } pmhw;
 
 /*
@@ -66,16 +93,31 @@ Interfaces
 */
 
 void pmhw_init(int num_clients, int num_puppets) {
+  pmhw_config_t config = pmhw_config_default(num_clients, num_puppets);
+  pmhw_init_ex(&config);
+}
+
+void pmhw_init_ex(const pmhw_config_t *config) {
+  // Sizes and policies are fixed in the hardware
   pmhw.initialized = true;
+  pmhw.num_committed.store(0, std::memory_order_relaxed);
+  pmhw.init_time = std::chrono::steady_clock::now();
+  pmhw.shut_down = false;
+  pmhw.reserved.assign(config->num_clients, packed_txn_t());
   pmhw.setup = std::make_unique<HostSetupRequestProxy>(IfcNames_HostSetupRequestS2H);
   pmhw.txn = std::make_unique<HostTxnRequestProxy>(IfcNames_HostTxnRequestS2H);
   pmhw.workDone = std::make_unique<HostWorkDoneProxy>(IfcNames_HostWorkDoneS2H);
   pmhw.debugInd = std::make_unique<DebugIndication>(IfcNames_DebugIndicationH2S);
-  pmhw.workInd = std::make_unique<WorkIndication>(IfcNames_WorkIndicationH2S);
+  pmhw.workInd = std::make_unique<WorkIndication>(IfcNames_WorkIndicationH2S, config->num_puppets);
   pmhw.txn->clearState();
 }
 
-void pmhw_shutdown() {}
+void pmhw_shutdown() {
+  if (pmhw.shut_down) return;
+  pmhw.shutdown_time = std::chrono::steady_clock::now();
+  pmhw.shut_down = true;
+  if (pmhw.workInd) pmhw.workInd->stop();
+}
 
 void pmhw_schedule(int client_id, const txn_t *txn) {
   ASSERT(pmhw.initialized);
@@ -93,12 +135,151 @@ void pmhw_schedule(int client_id, const txn_t *txn) {
   // );
 }
 
+// The host sees no credits for the hardware submission queue, so it cannot submit without waiting
+pmhw_status_t pmhw_try_schedule(int client_id, const txn_t *txn) {
+  if (!pmhw.initialized) return PMHW_SHUT_DOWN;
+  return PMHW_UNSUPPORTED;
+}
+
+int pmhw_queue_depth(int client_id) {
+  return -1;
+}
+
+// The hardware takes descriptors by value, so reservations live in host memory
+packed_txn_t *pmhw_reserve_txn(int client_id) {
+  ASSERT(pmhw.initialized);
+  return &pmhw.reserved[client_id];
+}
+
+void pmhw_commit_txn(int client_id, packed_txn_t *txn) {
+  ASSERT(txn->num_objs <= MAX_TXN_OBJS);
+  txn_t full;
+  full.id = txn->id;
+  full.aux_data = txn->aux_data;
+  full.num_objs = txn->num_objs;
+  for (int i = 0; i < (int)txn->num_objs; ++i) full.objs[i] = txn->objs[i];
+  pmhw_schedule(client_id, &full);
+}
+
 bool pmhw_poll_scheduled(int puppet_id, txn_id_t *txn_id) {
-  // TODO
-  return false;
+  ASSERT(pmhw.initialized);
+  return pmhw.workInd->take(puppet_id, txn_id, 1) > 0;
 }
 
 void pmhw_report_done(int puppet_id, txn_id_t txn_id) {
   // TODO
+  pmhw.num_committed.fetch_add(1, std::memory_order_relaxed);
 }
 
+void pmhw_schedule_batch(int client_id, const txn_t *txns, int n) {
+  for (int i = 0; i < n; ++i) pmhw_schedule(client_id, &txns[i]);
+}
+
+int pmhw_poll_scheduled_batch(int puppet_id, txn_id_t *txn_ids, int max) {
+  ASSERT(pmhw.initialized);
+  if (max <= 0) return 0;
+  return pmhw.workInd->take(puppet_id, txn_ids, max);
+}
+
+void pmhw_report_done_batch(int puppet_id, const txn_id_t *txn_ids, int n) {
+  for (int i = 0; i < n; ++i) pmhw_report_done(puppet_id, txn_ids[i]);
+}
+
+// The hardware schedules pessimistically and never aborts
+int pmhw_poll_aborted(int client_id, txn_id_t *txn_ids, int max) {
+  return 0;
+}
+
+// Summary and shard counters belong to the software policies and stay zero here
+void pmhw_get_stats(pmhw_stats_t *stats) {
+  ASSERT(stats);
+  *stats = pmhw_stats_t();
+  stats->num_committed = pmhw.num_committed.load(std::memory_order_relaxed);
+  auto now = pmhw.shut_down ? pmhw.shutdown_time : std::chrono::steady_clock::now();
+  stats->elapsed = std::chrono::duration<double>(now - pmhw.init_time).count();
+}
+
+/*
+Contexts. The hardware is a single instance; its context is the default one.
+*/
+
+pmhw_ctx_t *pmhw_ctx_create(const pmhw_config_t *config) {
+  ASSERTF(!pmhw.initialized, "The hardware backend supports a single context");
+  pmhw_init_ex(config);
+  return &pmhw;
+}
+
+void pmhw_ctx_shutdown(pmhw_ctx_t *ctx) {
+  ASSERT(ctx == &pmhw);
+  pmhw_shutdown();
+}
+
+void pmhw_ctx_free(pmhw_ctx_t *ctx) {
+  if (!ctx) return;
+  ASSERT(ctx == &pmhw);
+  pmhw.initialized = false;
+}
+
+pmhw_ctx_t *pmhw_default_ctx() {
+  return pmhw.initialized ? &pmhw : NULL;
+}
+
+void pmhw_ctx_schedule(pmhw_ctx_t *ctx, int client_id, const txn_t *txn) {
+  ASSERT(ctx == &pmhw);
+  pmhw_schedule(client_id, txn);
+}
+
+pmhw_status_t pmhw_ctx_try_schedule(pmhw_ctx_t *ctx, int client_id, const txn_t *txn) {
+  ASSERT(ctx == &pmhw);
+  return pmhw_try_schedule(client_id, txn);
+}
+
+int pmhw_ctx_queue_depth(pmhw_ctx_t *ctx, int client_id) {
+  ASSERT(ctx == &pmhw);
+  return pmhw_queue_depth(client_id);
+}
+
+packed_txn_t *pmhw_ctx_reserve_txn(pmhw_ctx_t *ctx, int client_id) {
+  ASSERT(ctx == &pmhw);
+  return pmhw_reserve_txn(client_id);
+}
+
+void pmhw_ctx_commit_txn(pmhw_ctx_t *ctx, int client_id, packed_txn_t *txn) {
+  ASSERT(ctx == &pmhw);
+  pmhw_commit_txn(client_id, txn);
+}
+
+bool pmhw_ctx_poll_scheduled(pmhw_ctx_t *ctx, int puppet_id, txn_id_t *txn_id) {
+  ASSERT(ctx == &pmhw);
+  return pmhw_poll_scheduled(puppet_id, txn_id);
+}
+
+void pmhw_ctx_report_done(pmhw_ctx_t *ctx, int puppet_id, txn_id_t txn_id) {
+  ASSERT(ctx == &pmhw);
+  pmhw_report_done(puppet_id, txn_id);
+}
+
+void pmhw_ctx_schedule_batch(pmhw_ctx_t *ctx, int client_id, const txn_t *txns, int n) {
+  ASSERT(ctx == &pmhw);
+  pmhw_schedule_batch(client_id, txns, n);
+}
+
+int pmhw_ctx_poll_scheduled_batch(pmhw_ctx_t *ctx, int puppet_id, txn_id_t *txn_ids, int max) {
+  ASSERT(ctx == &pmhw);
+  return pmhw_poll_scheduled_batch(puppet_id, txn_ids, max);
+}
+
+void pmhw_ctx_report_done_batch(pmhw_ctx_t *ctx, int puppet_id, const txn_id_t *txn_ids, int n) {
+  ASSERT(ctx == &pmhw);
+  pmhw_report_done_batch(puppet_id, txn_ids, n);
+}
+
+int pmhw_ctx_poll_aborted(pmhw_ctx_t *ctx, int client_id, txn_id_t *txn_ids, int max) {
+  ASSERT(ctx == &pmhw);
+  return pmhw_poll_aborted(client_id, txn_ids, max);
+}
+
+void pmhw_ctx_get_stats(pmhw_ctx_t *ctx, pmhw_stats_t *stats) {
+  ASSERT(ctx == &pmhw);
+  pmhw_get_stats(stats);
+}
@@ -13,165 +13,1035 @@
 #include "pmhw.h"
 #include "pmlog.h"
 #include "spsc_queue.h"
-#include "st_queue.h"
+#include "txn_ring.h"
+#include "active_set.h"
+#include "pmwait.h"
+#include "sim_policy.h"
 
 // Sets how often to check for shutdown
 // This didn't seem to make a difference so I disabled it.
 #define RUNNING_CHECK_SHIFT 0
 
+// Policy used unless pmhw_config_t or the PMHW_POLICY environment variable names another one
+#ifndef SIM_DEFAULT_POLICY
+#ifdef SIM_BLOOM
+#define SIM_DEFAULT_POLICY "bloom"
+#else
+#define SIM_DEFAULT_POLICY "lookahead"
+#endif
+#endif
+
+// Affinity dispatch: log2 of the number of per-object records of the puppet that last ran the object.
+// Objects sharing a record only make for a worse guess.
+#ifndef SIM_AFFINITY_TABLE_BITS
+#define SIM_AFFINITY_TABLE_BITS 12
+#endif
+
+// Affinity dispatch: how many more in-flight transactions than the least loaded puppet
+// the preferred one may have before the transaction goes to the least loaded one instead
+#ifndef SIM_AFFINITY_SLACK
+#define SIM_AFFINITY_SLACK 2
+#endif
+
 SPSC_QUEUE_IMPL(txn_id_t, spsc_tid, spsc_tid_t)
-SPSC_QUEUE_IMPL(txn_t, spsc_txn, spsc_txn_t)
-ST_QUEUE_IMPL(txn_t, stq_txn, stq_txn_t)
-
-static spsc_txn_t pending_qs[MAX_CLIENTS];
-static spsc_tid_t sched_qs[MAX_PUPPETS];
-static spsc_tid_t done_qs[MAX_PUPPETS];
-
-static int num_clients = 0;
-static int num_puppets = 0;
-static stq_txn_t active_txns[MAX_PUPPETS];
-
-static pthread_t scheduler_thread;
-static atomic_bool scheduler_running = ATOMIC_VAR_INIT(false);
-
-static bool conflicts_with_active(const txn_t *new_txn) {
-  for (int puppet = 0; puppet < num_puppets; ++puppet) {
-    int j = active_txns[puppet].head;
-    while (j != active_txns[puppet].tail) {
-      if (check_txn_conflict(new_txn, &active_txns[puppet].buffer[j])) {
-        return true;
-      }
-      j = (j+1) & active_txns[puppet].mask;
+
+/*
+Work stealing: a puppet with nothing queued takes up to half of a peer's sched queue, so all
+consumers of sched queues go through spsc_tid_deq_batch_mc. The thief then sends a steal notice,
+the ID tagged with STEAL_NOTICE, through its own done queue ahead of the done report,
+and the scheduler moves the transaction to the thief in its bookkeeping. It stays charged to the
+puppet it was dispatched to until it completes, so no puppet gets more than active_per_puppet
+dispatched and the active set never overflows.
+*/
+#define STEAL_NOTICE (1ULL << 63)
+
+/*
+Sharding: with num_shards > 1, object IDs are hashed to shards and puppet p belongs to shard
+p % num_shards. Each shard is a scheduler thread with its own policy state, active set and
+lookahead windows, and only ever checks the objects it owns.
+A client sends each transaction to the lowest shard it touches. A transaction touching several
+shards is admitted by all of them in ascending order: a shard that admits it holds its objects and
+forwards it to the next one, and the highest one dispatches it to one of its puppets. On completion,
+that shard releases it and sends a release message to the others.
+A shard only ever waits for shards above it and the highest for puppets, so holds cannot form a cycle.
+Each shard windows its clients and, after them, one input lane per lower shard forwarding to it.
+*/
+#define SIM_MAX_SHARDS 64
+
+// Aborted transactions that did not fit into their client's abort queue yet
+typedef struct {
+  txn_id_t *ids;
+  int len, cap;
+} abort_overflow_t;
+
+/*
+Lookahead window of transactions taken off a pending queue but not yet scheduled,
+policy->window entries per lane. With sharding, the shard's own objects come first
+and txn.num_objs only counts those, so that is all the policy sees.
+*/
+typedef struct {
+  txn_t txn;
+  int num_objs;     // objects of the whole transaction
+  uint64_t shards;  // shards the transaction touches
+  int bypassed;     // number of younger transactions scheduled ahead of this one
+  bool stalled;     // already counted towards num_stalled
+} lookahead_entry_t;
+
+/*
+One scheduler thread and everything only it touches, except for its wakeup event
+*/
+typedef struct {
+  pmwait_event_t event;            // new pending, forwarded, released or done items
+  pmhw_ctx_t *ctx;
+  int id;
+  int num_lanes;                   // clients, then the shards below this one
+  int num_puppets;                 // puppets owned by this shard
+
+  active_set_t active_txns;        // dispatched here, or held for a higher shard
+  uint64_t *release_to;            // per active slot: other shards to release it on completion
+  int num_held;                    // active transactions dispatched by a higher shard
+  int max_held;
+  int *num_inflight;               // active transactions dispatched to each puppet, stolen or not
+  int *charged_to;                 // per active slot: puppet it was dispatched to, whose num_inflight it counts in
+  txn_id_t *done_buf;              // scratch space for draining one done or release queue
+  uint16_t *affinity;              // affinity dispatch: per hashed object, 1 + the puppet that last ran it, or 0
+
+  // Scheduling policy, see sim_policy.h
+  void *policy_state;
+  sim_view_t policy_view;
+
+  lookahead_entry_t *lookahead;
+  int *lookahead_len;
+  const txn_t **candidates;   // every windowed transaction, for policies that look at whole batches
+
+  pthread_t thread;
+
+  // Scheduler thread state carried across passes
+  int next_puppet_id;   // round-robin position, also breaks ties between equally loaded puppets
+  int first_lane;
+
+  // Statistics, reported on shutdown
+  uint64_t num_scheduled;
+  uint64_t num_stalled;     // distinct transactions that were held back by the policy
+  uint64_t num_stolen;
+  uint64_t num_forwarded;   // admitted and passed on to a higher shard
+  uint64_t num_affine;      // affinity dispatch: sent to a remembered puppet rather than the least loaded
+  double cpu_time;
+} sim_shard_t;
+
+/*
+One scheduler instance. Everything is sized from the configuration in pmhw_ctx_create.
+*/
+struct pmhw_ctx {
+  txn_ring_t *pending_qs;   // compact descriptors, see txn_ring.h; per client and shard
+  spsc_tid_t *sched_qs;
+  spsc_tid_t *done_qs;
+  spsc_tid_t *abort_qs;     // per client, only used by policies that validate
+  txn_ring_t *forward_qs;   // shard i to shard j > i, at i * num_shards + j
+  spsc_tid_t *release_qs;   // shard j to shard i < j, at j * num_shards + i
+  packed_txn_t *reserved;   // per client: zero-copy submissions when sharded, routed on commit
+
+  int num_clients;
+  int num_puppets;
+  int num_shards;
+  int active_per_puppet;
+  int scheduler_core;
+  pmhw_dispatch_t dispatch;
+  pmhw_wait_t wait_strategy;
+  bool work_stealing;
+
+  // Wakeups for sleeping threads, see pmwait.h
+  pmwait_event_t *client_events;   // space freed in a pending queue
+  pmwait_event_t *puppet_events;   // new items in a sched queue
+  abort_overflow_t *abort_overflow;
+
+  const sim_policy_t *policy;
+  sim_shard_t *shards;
+  atomic_bool scheduler_running;
+
+  // Readable by anyone through pmhw_ctx_get_stats
+  atomic_uint_fast64_t num_committed;
+  atomic_uint_fast64_t num_aborted;
+  atomic_uint_fast64_t num_cross_shard;
+  sim_counters_t policy_counters;
+  struct timespec init_time, shutdown_time;
+};
+
+// Context behind the functions without a context argument
+static pmhw_ctx_t *default_ctx;
+
+// Shard owning an object. Mixed differently from the hash tables, which would otherwise see only a slice of their range.
+static inline int obj_shard(const pmhw_ctx_t *ctx, obj_id_t obj) {
+  uint64_t h = obj & ~(1ULL << 63);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  return (int)(((h & 0xffffffffull) * (uint64_t)ctx->num_shards) >> 32);
+}
+
+// Shard a client sends a transaction to: the lowest one it touches
+static inline int entry_shard(const pmhw_ctx_t *ctx, const obj_id_t *objs, int n) {
+  int shard = ctx->num_shards - 1;
+  for (int i = 0; i < n && shard > 0; ++i) {
+    int s = obj_shard(ctx, objs[i]);
+    if (s < shard) shard = s;
+  }
+  return ctx->num_shards == 1 || n == 0 ? 0 : shard;
+}
+
+/*
+Prepare a transaction that just entered a window: find the shards it touches and move this
+shard's objects to the front, which is all the policy gets to see
+*/
+static void split_objs(const pmhw_ctx_t *ctx, int shard_id, lookahead_entry_t *e) {
+  e->num_objs = (int)e->txn.num_objs;
+  e->shards = 1ULL << shard_id;
+  if (ctx->num_shards == 1) return;
+
+  obj_id_t other[MAX_TXN_OBJS];
+  int num_local = 0, num_other = 0;
+  for (int i = 0; i < e->num_objs; ++i) {
+    obj_id_t obj = e->txn.objs[i];
+    int s = obj_shard(ctx, obj);
+    e->shards |= 1ULL << s;
+    if (s == shard_id) e->txn.objs[num_local++] = obj;
+    else other[num_other++] = obj;
+  }
+  memcpy(&e->txn.objs[num_local], other, sizeof(obj_id_t) * num_other);
+  e->txn.num_objs = num_local;
+}
+
+// Next puppet of the same shard, wrapping around
+static inline int next_puppet(const sim_shard_t *shard, int puppet) {
+  puppet += shard->ctx->num_shards;
+  return puppet < shard->ctx->num_puppets ? puppet : shard->id;
+}
+
+/*
+Choose the puppet for the next scheduled transaction, or -1 if none can take it.
+Only the shard's own puppets are considered.
+Round robin sticks to the puppet whose turn it is, even if others are idle.
+Least loaded picks the puppet with the fewest in-flight transactions,
+starting the search from the round-robin position to spread ties.
+Affinity starts from the least loaded one too, see affinity_puppet.
+Policies may override this.
+*/
+static int pick_puppet(sim_shard_t *shard, int rr_puppet_id) {
+  pmhw_ctx_t *ctx = shard->ctx;
+  if (ctx->policy->pick_puppet) return ctx->policy->pick_puppet(shard->policy_state, rr_puppet_id);
+
+  if (ctx->dispatch == PMHW_DISPATCH_ROUND_ROBIN) {
+    return shard->num_inflight[rr_puppet_id] >= ctx->active_per_puppet ? -1 : rr_puppet_id;
+  }
+
+  int best = -1;
+  int best_len = ctx->active_per_puppet;
+  int puppet = rr_puppet_id;
+  for (int k = 0; k < shard->num_puppets; ++k, puppet = next_puppet(shard, puppet)) {
+    int len = shard->num_inflight[puppet];
+    if (len < best_len) {
+      best = puppet;
+      best_len = len;
+      if (len == 0) break;
     }
   }
-  return false;
+  return best;
+}
+
+static inline int affinity_entry(obj_id_t obj) {
+  return (int)(((obj & ~(1ULL << 63)) * 0x9e3779b97f4a7c15ull) >> (64 - SIM_AFFINITY_TABLE_BITS));
 }
 
 /*
-The scheduler thread
+Affinity dispatch: the puppet that last ran most of the transaction's objects, as long as it has
+room and at most SIM_AFFINITY_SLACK more in flight than the least loaded one, which is the fallback
 */
-static void *scheduler_loop(void *arg) {
-  pin_thread_to_core(SCHEDULER_CORE_ID);
-  (void)arg;
+static int affinity_puppet(sim_shard_t *shard, const txn_t *txn, int least_loaded) {
+  int candidates[MAX_TXN_OBJS], votes[MAX_TXN_OBJS];
+  int num_candidates = 0, best = -1, best_votes = 0;
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    int puppet = shard->affinity[affinity_entry(txn->objs[i])] - 1;
+    if (puppet < 0) continue;
+    int c = 0;
+    while (c < num_candidates && candidates[c] != puppet) c++;
+    if (c == num_candidates) {
+      candidates[num_candidates++] = puppet;
+      votes[c] = 0;
+    }
+    if (++votes[c] > best_votes) {
+      best = puppet;
+      best_votes = votes[c];
+    }
+  }
+  if (best < 0 || best == least_loaded) return least_loaded;
+  int len = shard->num_inflight[best];
+  if (len >= shard->ctx->active_per_puppet || len > shard->num_inflight[least_loaded] + SIM_AFFINITY_SLACK) return least_loaded;
+  return best;
+}
 
-  int current_puppet_id = 0;
-  int check_cnt = 0;
+// Remember which puppet ran the objects of a transaction
+static inline void affinity_record(sim_shard_t *shard, const txn_t *txn, int puppet) {
+  for (int i = 0; i < (int)txn->num_objs; ++i) shard->affinity[affinity_entry(txn->objs[i])] = (uint16_t)(puppet + 1);
+}
+
+/*
+Pass an aborted transaction back to its client. Clients poll for aborts between submissions,
+so the abort queue may be full for a while; the overflow keeps the rest in order meanwhile.
+*/
+static void hand_back_aborted(pmhw_ctx_t *ctx, int client, txn_id_t txn_id) {
+  abort_overflow_t *o = &ctx->abort_overflow[client];
+  if (o->len == 0 && spsc_tid_enq(&ctx->abort_qs[client], &txn_id)) return;
+  if (o->len == o->cap) {
+    o->cap = o->cap ? 2 * o->cap : 64;
+    o->ids = (txn_id_t *) realloc(o->ids, sizeof(txn_id_t) * o->cap);
+    ASSERT(o->ids);
+  }
+  o->ids[o->len++] = txn_id;
+}
 
-  while (check_cnt++ % (1<<RUNNING_CHECK_SHIFT) != 0 || atomic_load_explicit(&scheduler_running, memory_order_relaxed)) {
+// Move overflowing aborts into the abort queues as clients make room
+static bool flush_aborted(pmhw_ctx_t *ctx) {
+  bool progress = false;
+  for (int client = 0; client < ctx->num_clients; ++client) {
+    abort_overflow_t *o = &ctx->abort_overflow[client];
+    if (o->len == 0) continue;
+    int n = spsc_tid_enq_batch(&ctx->abort_qs[client], o->ids, o->len);
+    if (n == 0) continue;
+    memmove(o->ids, o->ids + n, sizeof(txn_id_t) * (o->len - n));
+    o->len -= n;
+    progress = true;
+  }
+  return progress;
+}
+
+// Drop a completed or released transaction from the active set and the policy state
+static void retire(sim_shard_t *shard, int slot) {
+  active_set_remove(&shard->active_txns, slot);
+  // The slot keeps its contents until the next insert, and the policy sees the active set without it
+  shard->ctx->policy->on_complete(shard->policy_state, &shard->active_txns.slots[slot].txn);
+}
+
+// Release messages need no room check: each queue fits everything its receiver may hold
+static void send_releases(sim_shard_t *shard, uint64_t shards, txn_id_t txn_id) {
+  pmhw_ctx_t *ctx = shard->ctx;
+  for (; shards; shards &= shards - 1) {
+    int to = __builtin_ctzll(shards);
+    while (!spsc_tid_enq(&ctx->release_qs[shard->id * ctx->num_shards + to], &txn_id)) pmwait_relax(ctx->wait_strategy);
+    pmwait_notify(ctx->wait_strategy, &ctx->shards[to].event);
+  }
+}
+
+// Queue a lane of a shard takes transactions from
+static inline txn_ring_t *lane_queue(sim_shard_t *shard, int lane) {
+  pmhw_ctx_t *ctx = shard->ctx;
+  if (lane < ctx->num_clients) return &ctx->pending_qs[lane * ctx->num_shards + shard->id];
+  return &ctx->forward_qs[(lane - ctx->num_clients) * ctx->num_shards + shard->id];
+}
 
-    // Drain done queue
-    for (int puppet = 0; puppet < num_puppets; ++puppet) {
-      if (stq_txn_empty(&active_txns[puppet])) {
-        DEBUG_MSG("skipping puppet %d done queue because no active txns", puppet);
+/*
+One pass of the scheduler over all queues. Returns whether anything happened.
+*/
+static bool scheduler_step(sim_shard_t *shard) {
+  pmhw_ctx_t *ctx = shard->ctx;
+  const sim_policy_t *policy = ctx->policy;
+  bool progress = policy->validate && flush_aborted(ctx);
+
+  // Drain release queues of the shards above
+  for (int from = shard->id + 1; from < ctx->num_shards && shard->num_held > 0; ++from) {
+    int num_released = spsc_tid_deq_batch(&ctx->release_qs[from * ctx->num_shards + shard->id], shard->done_buf, ctx->active_per_puppet);
+    if (num_released > 0) progress = true;
+    for (int d = 0; d < num_released; ++d) {
+      int slot = active_set_find(&shard->active_txns, shard->done_buf[d]);
+      ASSERTF(slot >= 0 && shard->active_txns.slots[slot].puppet < 0, "Shard %d released unknown txn %lu", from, shard->done_buf[d]);
+      retire(shard, slot);
+      shard->num_held--;
+    }
+  }
+
+  // Drain done queue
+  for (int puppet = shard->id; puppet < ctx->num_puppets; puppet += ctx->num_shards) {
+    // A thief may have nothing in flight yet and still have sent steal notices
+    if (shard->num_inflight[puppet] == 0 && !ctx->work_stealing) {
+      DEBUG_MSG("skipping puppet %d done queue because no active txns", puppet);
+      continue;
+    }
+    int num_done = spsc_tid_deq_batch(&ctx->done_qs[puppet], shard->done_buf, ctx->active_per_puppet);
+    if (num_done > 0) progress = true;
+    for (int d = 0; d < num_done; ++d) {
+      txn_id_t txn_id = shard->done_buf[d];
+      if (txn_id & STEAL_NOTICE) {
+        txn_id &= ~STEAL_NOTICE;
+        int slot = active_set_find(&shard->active_txns, txn_id);
+        ASSERTF(slot >= 0, "Puppet %d stole unknown txn %lu", puppet, txn_id);
+        shard->active_txns.slots[slot].puppet = puppet;
+        shard->num_stolen++;
+        if (shard->affinity) affinity_record(shard, &shard->active_txns.slots[slot].txn, puppet);
         continue;
       }
-      txn_id_t txn_id;
-      while (spsc_tid_deq(&done_qs[puppet], &txn_id)) {
-        DEBUG_MSG("done queue of puppet %d has tid %d", puppet, txn_id);
-        // find the transaction in active list
-        // we expect the worker to return transaction in FIFO order
-        txn_t txn;
-        ASSERT(stq_txn_deq(&active_txns[puppet], &txn));
-        ASSERT(txn.id == txn_id);
+      DEBUG_MSG("done queue of puppet %d has tid %d", puppet, txn_id);
+      // find the transaction in active set, puppets may complete them in any order
+      int slot = active_set_find(&shard->active_txns, txn_id);
+      ASSERTF(slot >= 0, "Puppet %d reported unknown txn %lu", puppet, txn_id);
+      ASSERT(shard->active_txns.slots[slot].puppet == puppet);
+      int client = shard->active_txns.slots[slot].client;
+      if (!policy->validate || policy->validate(shard->policy_state, &shard->active_txns.slots[slot].txn)) {
         pmlog_record(txn_id, PMLOG_CLEANUP, -1LLU);
+        atomic_fetch_add_explicit(&ctx->num_committed, 1, memory_order_relaxed);
+      } else {
+        pmlog_record(txn_id, PMLOG_ABORT, client);
+        hand_back_aborted(ctx, client, txn_id);
+        atomic_fetch_add_explicit(&ctx->num_aborted, 1, memory_order_relaxed);
       }
+      if (shard->release_to[slot]) send_releases(shard, shard->release_to[slot], txn_id);
+      shard->num_inflight[shard->charged_to[slot]]--;
+      retire(shard, slot);
     }
+  }
 
-    // Drain pending queue
-    for (int client = 0; client < num_clients; ++client) {
-      // No space to schedule, break
-      if (stq_txn_full(&active_txns[current_puppet_id])) {
-        DEBUG_MSG("active_txn for current puppet %d is full, so no more scheduling", current_puppet_id);
-        break;
+  // Top up the lookahead windows, keeping submission order
+  for (int lane = 0; lane < shard->num_lanes; ++lane) {
+    lookahead_entry_t *window = &shard->lookahead[lane * policy->window];
+    int *len = &shard->lookahead_len[lane];
+    int old_len = *len;
+    while (*len < policy->window && txn_ring_deq(lane_queue(shard, lane), &window[*len].txn)) {
+      DEBUG_MSG("moved transaction id %d into lookahead window", window[*len].txn.id);
+      split_objs(ctx, shard->id, &window[*len]);
+      window[*len].bypassed = 0;
+      window[*len].stalled = false;
+      (*len)++;
+    }
+    if (*len > old_len) {
+      progress = true;
+      if (lane < ctx->num_clients) pmwait_notify(ctx->wait_strategy, &ctx->client_events[lane]);
+      else pmwait_notify(ctx->wait_strategy, &ctx->shards[lane - ctx->num_clients].event);
+    }
+  }
+
+  // Rotate which lane goes first so none of them starves
+  shard->first_lane = (shard->first_lane + 1) % shard->num_lanes;
+
+  // Show batch policies everything that is waiting, in the order it will be offered
+  if (policy->begin_pass) {
+    int n = 0;
+    for (int l = 0; l < shard->num_lanes; ++l) {
+      int lane = (shard->first_lane + l) % shard->num_lanes;
+      for (int i = 0; i < shard->lookahead_len[lane]; ++i) {
+        shard->candidates[n++] = &shard->lookahead[lane * policy->window + i].txn;
       }
+    }
+    policy->begin_pass(shard->policy_state, shard->candidates, n);
+  }
+
+  // Schedule from the windows
+  int puppet_id = pick_puppet(shard, shard->next_puppet_id);
+  for (int l = 0; l < shard->num_lanes; ++l) {
+    int lane = (shard->first_lane + l) % shard->num_lanes;
+
+    // No space to schedule, break
+    if (puppet_id < 0 && shard->num_held >= shard->max_held) {
+      DEBUG_MSG("no puppet can take more transactions, so no more scheduling");
+      break;
+    }
+
+    // Schedule any transaction in the window the policy admits, oldest first
+    lookahead_entry_t *window = &shard->lookahead[lane * policy->window];
+    int *len = &shard->lookahead_len[lane];
+    int i = 0;
+    while (i < *len) {
+      txn_t *txn = &window[i].txn;
+      DEBUG_MSG("found a transaction id %d", txn->id);
 
-      txn_t txn;
-      DEBUG_MSG("now peeking transaction in pending queue");
-      while (spsc_txn_peek(&pending_qs[client], &txn)) {
-        DEBUG_MSG("found a transaction id %d", txn.id);
-        // If conflict, also break
-        if (conflicts_with_active(&txn)) {
-          DEBUG_MSG("it conflicts");
-          break;
+      // The highest shard of a transaction dispatches it, the others need room to hold and forward it
+      int next_shard = (window[i].shards >> shard->id) == 1 ? -1 : shard->id + 1 + __builtin_ctzll(window[i].shards >> (shard->id + 1));
+      txn_ring_t *forward_q = next_shard < 0 ? NULL : &ctx->forward_qs[shard->id * ctx->num_shards + next_shard];
+      if (next_shard < 0 ? puppet_id < 0
+                         : shard->num_held >= shard->max_held || txn_ring_space(forward_q) < txn_ring_lines(window[i].num_objs)) {
+        if (window[i].bypassed >= policy->max_bypass) break;
+        i++;
+        continue;
+      }
+
+      if (!policy->admit(shard->policy_state, txn)) {
+        DEBUG_MSG("it conflicts");
+        // Count each held-back transaction once, no matter how many times we retry it
+        if (!window[i].stalled) {
+          window[i].stalled = true;
+          shard->num_stalled++;
+          if (policy->on_stall) policy->on_stall(shard->policy_state, txn);
         }
+        // Aging: once bypassed too often, nothing younger may overtake this transaction
+        if (window[i].bypassed >= policy->max_bypass) break;
+        i++;
+        continue;
+      }
 
-        // If successfully scheduled, then must put it in our active list
-        ASSERT(spsc_txn_deq(&pending_qs[client], &txn));
-        ASSERT(stq_txn_enq(&active_txns[current_puppet_id], txn));
-        DEBUG_MSG("removed from pending, enqueued to active");
+      // If successfully scheduled, then must put it in our active list
+      ASSERTF(!ctx->work_stealing || !(txn->id & STEAL_NOTICE), "Txn id %lu collides with steal notices", txn->id);
+      int client = lane < ctx->num_clients ? lane : -1;
+      int target = next_shard >= 0 ? -1 : shard->affinity ? affinity_puppet(shard, txn, puppet_id) : puppet_id;
+      int slot = active_set_insert(&shard->active_txns, txn, target, client);
+      shard->release_to[slot] = window[i].shards & ~(1ULL << shard->id);
+      shard->charged_to[slot] = target;
+      policy->on_schedule(shard->policy_state, txn);
+      progress = true;
 
-        // Log and send message to the user
-        pmlog_record(txn.id, PMLOG_SCHED_READY, current_puppet_id);
-        DEBUG_MSG("enqueing to scheuled queue of %d", current_puppet_id);
-        ASSERT(spsc_tid_enq(&sched_qs[current_puppet_id], &txn.id));
-
-        // Move to next puppet in round robin oder
-        current_puppet_id = (current_puppet_id + 1) % num_puppets;
-        DEBUG_MSG("now moving onto %d", current_puppet_id);
-
-        // No space to schedule more, break
-        if (stq_txn_full(&active_txns[current_puppet_id])) {
-          DEBUG_MSG("puppet %d is full", current_puppet_id);
-          break;
+      if (next_shard >= 0) {
+        // Hold this shard's objects and let the next shard admit the rest
+        txn->num_objs = window[i].num_objs;
+        ASSERT(txn_ring_enq(forward_q, txn));
+        pmwait_notify(ctx->wait_strategy, &ctx->shards[next_shard].event);
+        shard->num_held++;
+        shard->num_forwarded++;
+      } else {
+        shard->num_inflight[target]++;
+        shard->num_scheduled++;
+        if (shard->release_to[slot]) atomic_fetch_add_explicit(&ctx->num_cross_shard, 1, memory_order_relaxed);
+        if (shard->affinity) {
+          shard->num_affine += target != puppet_id;
+          affinity_record(shard, txn, target);
         }
+        DEBUG_MSG("removed from lookahead, enqueued to active");
+
+        // Log and send message to the user
+        pmlog_record(txn->id, PMLOG_SCHED_READY, target);
+        DEBUG_MSG("enqueing to scheuled queue of %d", target);
+        ASSERT(spsc_tid_enq(&ctx->sched_qs[target], &txn->id));
+        pmwait_notify(ctx->wait_strategy, &ctx->puppet_events[target]);
+
+        // Move to next puppet according to the dispatch policy
+        shard->next_puppet_id = next_puppet(shard, target);
+        puppet_id = pick_puppet(shard, shard->next_puppet_id);
+        DEBUG_MSG("now moving onto %d", puppet_id);
+      }
+
+      // Everything older has now been bypassed once more
+      for (int k = 0; k < i; ++k) window[k].bypassed++;
+      memmove(&window[i], &window[i+1], sizeof(lookahead_entry_t) * (*len - i - 1));
+      (*len)--;
+
+      // No space to schedule more, break
+      if (puppet_id < 0 && shard->num_held >= shard->max_held) {
+        DEBUG_MSG("no puppet can take more transactions");
+        break;
       }
     }
   }
+
+  return progress;
+}
+
+/*
+The scheduler thread of a shard
+*/
+static void *scheduler_loop(void *arg) {
+  sim_shard_t *shard = (sim_shard_t *) arg;
+  pmhw_ctx_t *ctx = shard->ctx;
+  if (ctx->scheduler_core >= 0) pin_thread_to_core(ctx->scheduler_core + shard->id);
+
+  int check_cnt = 0;
+  int idle_cnt = 0;
+
+  while (check_cnt++ % (1<<RUNNING_CHECK_SHIFT) != 0 || atomic_load_explicit(&ctx->scheduler_running, memory_order_relaxed)) {
+    if (scheduler_step(shard)) {
+      idle_cnt = 0;
+      continue;
+    }
+
+    // Nothing to do: spin for a while, then sleep until a client, puppet or shard publishes something
+    if (ctx->wait_strategy != PMHW_WAIT_SLEEP || ++idle_cnt < PMWAIT_SPIN_LIMIT) {
+      pmwait_relax(ctx->wait_strategy);
+      continue;
+    }
+    unsigned ticket = pmwait_prepare(&shard->event);
+    if (!scheduler_step(shard)) pmwait_sleep(&shard->event, ticket);
+    pmwait_finish(&shard->event);
+  }
+
+  struct timespec cpu;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+  shard->cpu_time = cpu.tv_sec + cpu.tv_nsec / 1e9;
   return NULL;
 }
 
+// Smallest ring that holds n items; rings are powers of two and keep one slot empty
+static int ring_capacity(int n) {
+  int capacity = 2;
+  while (capacity <= n) capacity <<= 1;
+  return capacity;
+}
+
+/*
+Queues and wakeups are shared with client and puppet threads, which may still be on their way
+out of a call that pmhw_ctx_shutdown interrupted. So they outlive the shutdown and get released
+by pmhw_ctx_free.
+*/
+static void release_queues(pmhw_ctx_t *ctx) {
+  int k = ctx->num_shards;
+  if (ctx->pending_qs) {
+    for (int i = 0; i < ctx->num_clients * k; ++i) txn_ring_free(&ctx->pending_qs[i]);
+    for (int i = 0; i < ctx->num_clients; ++i) spsc_tid_free(&ctx->abort_qs[i]);
+    for (int i = 0; i < ctx->num_puppets; ++i) spsc_tid_free(&ctx->done_qs[i]);
+    for (int i = 0; i < ctx->num_puppets; ++i) spsc_tid_free(&ctx->sched_qs[i]);
+    for (int i = 0; i < k; ++i) {
+      for (int j = i + 1; j < k; ++j) txn_ring_free(&ctx->forward_qs[i * k + j]);
+      for (int j = 0; j < i; ++j) spsc_tid_free(&ctx->release_qs[i * k + j]);
+    }
+  }
+  free(ctx->pending_qs);
+  free(ctx->abort_qs);
+  free(ctx->sched_qs);
+  free(ctx->done_qs);
+  free(ctx->forward_qs);
+  free(ctx->release_qs);
+  free(ctx->reserved);
+  free(ctx->client_events);
+  free(ctx->puppet_events);
+  free(ctx->shards);
+  ctx->pending_qs = NULL;
+  ctx->abort_qs = NULL;
+  ctx->sched_qs = NULL;
+  ctx->done_qs = NULL;
+  ctx->forward_qs = NULL;
+  ctx->release_qs = NULL;
+  ctx->reserved = NULL;
+  ctx->client_events = NULL;
+  ctx->puppet_events = NULL;
+  ctx->shards = NULL;
+}
+
+// Scheduler-side state of a shard; its event is already initialized
+static void shard_init(pmhw_ctx_t *ctx, sim_shard_t *shard, int id) {
+  shard->ctx = ctx;
+  shard->id = id;
+  shard->num_lanes = ctx->num_clients + id;
+  shard->num_puppets = (ctx->num_puppets - id + ctx->num_shards - 1) / ctx->num_shards;
+  shard->next_puppet_id = id;
+
+  // A shard holds at most as many transactions as all puppets together can run
+  int capacity = ctx->num_puppets * ctx->active_per_puppet;
+  shard->max_held = capacity - shard->num_puppets * ctx->active_per_puppet;
+  active_set_init(&shard->active_txns, capacity);
+  shard->release_to = (uint64_t *) malloc(sizeof(uint64_t) * capacity);
+  shard->charged_to = (int *) malloc(sizeof(int) * capacity);
+  shard->num_inflight = (int *) calloc(ctx->num_puppets, sizeof(int));
+  shard->done_buf = (txn_id_t *) malloc(sizeof(txn_id_t) * ctx->active_per_puppet);
+  shard->lookahead = (lookahead_entry_t *) malloc(sizeof(lookahead_entry_t) * shard->num_lanes * ctx->policy->window);
+  shard->lookahead_len = (int *) calloc(shard->num_lanes, sizeof(int));
+  shard->candidates = (const txn_t **) malloc(sizeof(txn_t *) * shard->num_lanes * ctx->policy->window);
+  ASSERT(shard->release_to && shard->charged_to && shard->num_inflight && shard->done_buf && shard->lookahead && shard->lookahead_len && shard->candidates);
+  if (ctx->dispatch == PMHW_DISPATCH_AFFINITY) {
+    shard->affinity = (uint16_t *) calloc(1 << SIM_AFFINITY_TABLE_BITS, sizeof(uint16_t));
+    ASSERT(shard->affinity);
+  }
+
+  shard->policy_view = (sim_view_t){
+    .counters = &ctx->policy_counters,
+    .active = &shard->active_txns,
+    .num_inflight = shard->num_inflight,
+    .num_clients = shard->num_lanes,
+    .num_puppets = ctx->num_puppets,
+    .active_per_puppet = ctx->active_per_puppet,
+  };
+  shard->policy_state = ctx->policy->create(&shard->policy_view);
+}
+
+static void shard_destroy(pmhw_ctx_t *ctx, sim_shard_t *shard) {
+  ctx->policy->destroy(shard->policy_state);
+  active_set_free(&shard->active_txns);
+  free(shard->release_to);
+  free(shard->charged_to);
+  free(shard->affinity);
+  free(shard->num_inflight);
+  free(shard->done_buf);
+  free(shard->lookahead);
+  free(shard->lookahead_len);
+  free(shard->candidates);
+}
+
 // === Interface Implementations ===
 
-void pmhw_init(int num_clients_, int num_puppets_) {
-  ASSERT(!atomic_load_explicit(&scheduler_running, memory_order_acquire));
-  num_clients = num_clients_;
-  num_puppets = num_puppets_;
-  ASSERT(num_clients <= MAX_CLIENTS);
-  ASSERT(num_puppets <= MAX_PUPPETS);
+pmhw_ctx_t *pmhw_ctx_create(const pmhw_config_t *config) {
+  ASSERT(config);
+  ASSERT(config->num_clients > 0 && config->num_puppets > 0);
+  ASSERT(config->pending_per_client > 0 && config->active_per_puppet > 0);
+  ASSERTF(config->dispatch != PMHW_DISPATCH_AFFINITY || config->num_puppets < UINT16_MAX, "Too many puppets for affinity dispatch");
+  ASSERTF(config->num_shards > 0 && config->num_shards <= SIM_MAX_SHARDS && config->num_shards <= config->num_puppets,
+          "Need 1 to %d shards and at least one puppet per shard, got %d shards for %d puppets",
+          SIM_MAX_SHARDS, config->num_shards, config->num_puppets);
+  pmhw_ctx_t *ctx = (pmhw_ctx_t *) aligned_alloc(64, (sizeof(pmhw_ctx_t) + 63) / 64 * 64);
+  ASSERT(ctx);
+  memset(ctx, 0, sizeof(pmhw_ctx_t));
 
-  // Internal bujffer
-  for (int i = 0; i < MAX_PUPPETS; ++i) stq_txn_init(&active_txns[i], MAX_ACTIVE_PER_PUPPET);
+  // Explicit configuration wins over the environment
+  const char *policy_name = config->policy;
+  if (!policy_name) policy_name = getenv("PMHW_POLICY");
+  if (!policy_name || !policy_name[0]) policy_name = SIM_DEFAULT_POLICY;
+  ctx->policy = sim_policy_find(policy_name);
+  if (!ctx->policy) FATAL("Unknown scheduling policy %s, expected one of: %s", policy_name, sim_policy_names());
+  // Validation would need every shard to agree at completion
+  if (ctx->policy->validate && config->num_shards > 1) FATAL("The %s policy cannot run sharded", ctx->policy->name);
+
+  ctx->num_clients = config->num_clients;
+  ctx->num_puppets = config->num_puppets;
+  ctx->num_shards = config->num_shards;
+  ctx->active_per_puppet = config->active_per_puppet;
+  ctx->scheduler_core = config->scheduler_core;
+  ctx->dispatch = config->dispatch;
+  ctx->wait_strategy = config->wait;
+  ctx->work_stealing = config->work_stealing;
+  int k = ctx->num_shards;
+
+  // Internal buffer
+  ctx->abort_overflow = (abort_overflow_t *) calloc(ctx->num_clients, sizeof(abort_overflow_t));
+  ctx->reserved = (packed_txn_t *) malloc(sizeof(packed_txn_t) * ctx->num_clients);
+  ASSERT(ctx->abort_overflow && ctx->reserved);
 
   // Initialize all the queues
-  for (int i = 0; i < MAX_CLIENTS; ++i) spsc_txn_init(&pending_qs[i], MAX_PENDING_PER_CLIENT);
-  for (int i = 0; i < MAX_PUPPETS; ++i) spsc_tid_init(&done_qs[i], MAX_ACTIVE_PER_PUPPET);
-  for (int i = 0; i < MAX_PUPPETS; ++i) spsc_tid_init(&sched_qs[i], MAX_ACTIVE_PER_PUPPET);
+  // Pending rings count cache lines, so they hold pending_per_client transactions even at MAX_TXN_OBJS.
+  // Done/sched queues fit every in-flight transaction of a puppet, so the scheduler never blocks on them.
+  // Abort queues fit every active transaction, which is plenty as long as clients keep polling.
+  ctx->pending_qs = (txn_ring_t *) aligned_alloc(64, sizeof(txn_ring_t) * ctx->num_clients * k);
+  ctx->abort_qs = (spsc_tid_t *) aligned_alloc(64, sizeof(spsc_tid_t) * ctx->num_clients);
+  ctx->sched_qs = (spsc_tid_t *) aligned_alloc(64, sizeof(spsc_tid_t) * ctx->num_puppets);
+  ctx->done_qs = (spsc_tid_t *) aligned_alloc(64, sizeof(spsc_tid_t) * ctx->num_puppets);
+  ctx->forward_qs = (txn_ring_t *) aligned_alloc(64, sizeof(txn_ring_t) * k * k);
+  ctx->release_qs = (spsc_tid_t *) aligned_alloc(64, sizeof(spsc_tid_t) * k * k);
+  ASSERT(ctx->pending_qs && ctx->abort_qs && ctx->sched_qs && ctx->done_qs && ctx->forward_qs && ctx->release_qs);
+  int pending_capacity = ring_capacity(config->pending_per_client * TXN_RING_MAX_LINES);
+  for (int i = 0; i < ctx->num_clients * k; ++i) txn_ring_init(&ctx->pending_qs[i], pending_capacity);
+  for (int i = 0; i < ctx->num_clients; ++i) spsc_tid_init(&ctx->abort_qs[i], ring_capacity(ctx->num_puppets * ctx->active_per_puppet));
+  for (int i = 0; i < ctx->num_puppets; ++i) spsc_tid_init(&ctx->done_qs[i], ring_capacity(ctx->active_per_puppet));
+  for (int i = 0; i < ctx->num_puppets; ++i) spsc_tid_init(&ctx->sched_qs[i], ring_capacity(ctx->active_per_puppet));
+  // Shards forward as much as a client can submit, and release at most what the receiver holds
+  for (int i = 0; i < k; ++i) {
+    for (int j = i + 1; j < k; ++j) txn_ring_init(&ctx->forward_qs[i * k + j], pending_capacity);
+    for (int j = 0; j < i; ++j) spsc_tid_init(&ctx->release_qs[i * k + j], ring_capacity(ctx->num_puppets * ctx->active_per_puppet));
+  }
+
+  // Wakeups
+  ctx->client_events = (pmwait_event_t *) aligned_alloc(64, sizeof(pmwait_event_t) * ctx->num_clients);
+  ctx->puppet_events = (pmwait_event_t *) aligned_alloc(64, sizeof(pmwait_event_t) * ctx->num_puppets);
+  ctx->shards = (sim_shard_t *) aligned_alloc(64, (sizeof(sim_shard_t) * k + 63) / 64 * 64);
+  ASSERT(ctx->client_events && ctx->puppet_events && ctx->shards);
+  memset(ctx->shards, 0, sizeof(sim_shard_t) * k);
+  for (int i = 0; i < ctx->num_clients; ++i) pmwait_init(&ctx->client_events[i]);
+  for (int i = 0; i < ctx->num_puppets; ++i) pmwait_init(&ctx->puppet_events[i]);
+  for (int i = 0; i < k; ++i) pmwait_init(&ctx->shards[i].event);
+
+  // Statistics, everything else starts out zeroed
+  atomic_init(&ctx->num_committed, 0);
+  atomic_init(&ctx->num_aborted, 0);
+  atomic_init(&ctx->num_cross_shard, 0);
+  atomic_init(&ctx->policy_counters.num_summary_checked, 0);
+  atomic_init(&ctx->policy_counters.num_false_positives, 0);
+  clock_gettime(CLOCK_MONOTONIC, &ctx->init_time);
+
+  for (int i = 0; i < k; ++i) shard_init(ctx, &ctx->shards[i], i);
+  INFO("Using scheduling policy %s%s", ctx->policy->name, ctx->work_stealing ? " with work stealing" : "");
+  if (k > 1) INFO("Sharded across %d scheduler threads", k);
 
   // Mark the scheduler running
-  atomic_store_explicit(&scheduler_running, true, memory_order_release);
-  
-  // Start the loop
-  EXPECT_OK(pthread_create(&scheduler_thread, NULL, scheduler_loop, NULL) == 0);
+  atomic_init(&ctx->scheduler_running, true);
+
+  // Start the loops
+  for (int i = 0; i < k; ++i) {
+    EXPECT_OK(pthread_create(&ctx->shards[i].thread, NULL, scheduler_loop, &ctx->shards[i]) == 0);
+  }
+  return ctx;
 }
 
-void pmhw_shutdown() {
-  ASSERT(atomic_load_explicit(&scheduler_running, memory_order_acquire));
-  atomic_store_explicit(&scheduler_running, false, memory_order_release);
+void pmhw_ctx_shutdown(pmhw_ctx_t *ctx) {
+  ASSERT(atomic_load_explicit(&ctx->scheduler_running, memory_order_acquire));
+  atomic_store_explicit(&ctx->scheduler_running, false, memory_order_release);
+
+  // Kick everyone who might be asleep so they notice
+  for (int i = 0; i < ctx->num_shards; ++i) pmwait_wake_all(&ctx->shards[i].event);
+  for (int i = 0; i < ctx->num_clients; ++i) pmwait_wake_all(&ctx->client_events[i]);
+  for (int i = 0; i < ctx->num_puppets; ++i) pmwait_wake_all(&ctx->puppet_events[i]);
 
-  EXPECT_OK(pthread_join(scheduler_thread, NULL) == 0);
-  for (int i = 0; i < MAX_PUPPETS; ++i) stq_txn_free(&active_txns[i]);
-  for (int i = 0; i < MAX_CLIENTS; ++i) spsc_txn_free(&pending_qs[i]);
-  for (int i = 0; i < MAX_PUPPETS; ++i) spsc_tid_free(&done_qs[i]);
-  for (int i = 0; i < MAX_PUPPETS; ++i) spsc_tid_free(&sched_qs[i]);
+  for (int i = 0; i < ctx->num_shards; ++i) EXPECT_OK(pthread_join(ctx->shards[i].thread, NULL) == 0);
+  clock_gettime(CLOCK_MONOTONIC, &ctx->shutdown_time);
+
+  uint64_t num_scheduled = 0, num_stalled = 0, num_stolen = 0, num_affine = 0;
+  double cpu_time = 0;
+  for (int i = 0; i < ctx->num_shards; ++i) {
+    sim_shard_t *shard = &ctx->shards[i];
+    num_scheduled += shard->num_scheduled;
+    num_stalled += shard->num_stalled;
+    num_stolen += shard->num_stolen;
+    num_affine += shard->num_affine;
+    cpu_time += shard->cpu_time;
+    if (ctx->num_shards > 1) {
+      INFO("Shard %d scheduled %lu txns and forwarded %lu, %lu held back, CPU time %.6f s",
+           i, shard->num_scheduled, shard->num_forwarded, shard->num_stalled, shard->cpu_time);
+    }
+  }
+  INFO("Scheduled %lu txns, %lu held back by the %s policy", num_scheduled, num_stalled, ctx->policy->name);
+  if (ctx->num_shards > 1) {
+    INFO("%lu txns spanned several shards", atomic_load_explicit(&ctx->num_cross_shard, memory_order_relaxed));
+  }
+  for (int i = 0; i < ctx->num_shards; ++i) {
+    if (ctx->policy->report) ctx->policy->report(ctx->shards[i].policy_state);
+  }
+  // The shards share these counters, so report them once
+  uint64_t checked = atomic_load_explicit(&ctx->policy_counters.num_summary_checked, memory_order_relaxed);
+  uint64_t false_positives = atomic_load_explicit(&ctx->policy_counters.num_false_positives, memory_order_relaxed);
+  if (checked > 0) {
+    INFO("Summary false positives: about %lu of %lu stalls (%.2f%%, sampled)", false_positives, checked, 100.0 * false_positives / checked);
+  }
+  if (ctx->dispatch == PMHW_DISPATCH_AFFINITY) {
+    INFO("Affinity sent %lu txns (%.2f%%) to the puppet that ran their objects before instead of the least loaded one",
+         num_affine, 100.0 * num_affine / (num_scheduled ? num_scheduled : 1));
+  }
+  if (ctx->work_stealing) INFO("Puppets stole %lu txns", num_stolen);
+  INFO("Scheduler thread used %.6f s of CPU time", cpu_time);
+
+  // Only the schedulers touch these, and they have stopped
+  for (int i = 0; i < ctx->num_shards; ++i) shard_destroy(ctx, &ctx->shards[i]);
+  for (int i = 0; i < ctx->num_clients; ++i) free(ctx->abort_overflow[i].ids);
+  free(ctx->abort_overflow);
 }
 
-void pmhw_schedule(int client_id, const txn_t *txn) {
+void pmhw_ctx_free(pmhw_ctx_t *ctx) {
+  if (!ctx) return;
+  ASSERT(!atomic_load_explicit(&ctx->scheduler_running, memory_order_acquire));
+  release_queues(ctx);
+  free(ctx);
+}
+
+void pmhw_ctx_schedule(pmhw_ctx_t *ctx, int client_id, const txn_t *txn) {
   ASSERT(txn);
+  int shard = entry_shard(ctx, txn->objs, (int)txn->num_objs);
   pmlog_record(txn->id, PMLOG_SUBMIT, -1LLU);
-  while (!spsc_txn_enq(&pending_qs[client_id], txn));
+  PMWAIT_UNTIL(ctx->wait_strategy, &ctx->client_events[client_id], &ctx->scheduler_running,
+               txn_ring_enq(&ctx->pending_qs[client_id * ctx->num_shards + shard], txn));
+  pmwait_notify(ctx->wait_strategy, &ctx->shards[shard].event);
 }
 
-bool pmhw_poll_scheduled(int puppet_id, txn_id_t *txn_id) {
+pmhw_status_t pmhw_ctx_try_schedule(pmhw_ctx_t *ctx, int client_id, const txn_t *txn) {
+  ASSERT(txn && txn->num_objs <= MAX_TXN_OBJS);
+  if (!atomic_load_explicit(&ctx->scheduler_running, memory_order_acquire)) return PMHW_SHUT_DOWN;
+  int shard = entry_shard(ctx, txn->objs, (int)txn->num_objs);
+  txn_ring_t *q = &ctx->pending_qs[client_id * ctx->num_shards + shard];
+  // Only this client adds to its queue, so room seen here stays there
+  if (txn_ring_space(q) < txn_ring_lines(txn->num_objs)) return PMHW_QUEUE_FULL;
+  pmlog_record(txn->id, PMLOG_SUBMIT, -1LLU);
+  ASSERT(txn_ring_enq(q, txn));
+  pmwait_notify(ctx->wait_strategy, &ctx->shards[shard].event);
+  return PMHW_ACCEPTED;
+}
+
+int pmhw_ctx_queue_depth(pmhw_ctx_t *ctx, int client_id) {
+  int depth = 0;
+  for (int shard = 0; shard < ctx->num_shards; ++shard) depth += txn_ring_size(&ctx->pending_qs[client_id * ctx->num_shards + shard]);
+  return depth;
+}
+
+// Sharded, the queue depends on the objects, so the descriptor is filled in aside and routed on commit
+packed_txn_t *pmhw_ctx_reserve_txn(pmhw_ctx_t *ctx, int client_id) {
+  if (ctx->num_shards > 1) return atomic_load_explicit(&ctx->scheduler_running, memory_order_acquire) ? &ctx->reserved[client_id] : NULL;
+  packed_txn_t *txn = NULL;
+  PMWAIT_UNTIL(ctx->wait_strategy, &ctx->client_events[client_id], &ctx->scheduler_running,
+               (txn = txn_ring_reserve(&ctx->pending_qs[client_id])) != NULL);
+  return txn;
+}
+
+void pmhw_ctx_commit_txn(pmhw_ctx_t *ctx, int client_id, packed_txn_t *txn) {
+  ASSERT(txn);
+  if (ctx->num_shards > 1) {
+    ASSERT(txn == &ctx->reserved[client_id] && txn->num_objs <= MAX_TXN_OBJS);
+    txn_t full;
+    full.id = txn->id;
+    full.aux_data = txn->aux_data;
+    full.num_objs = txn->num_objs;
+    memcpy(full.objs, txn->objs, sizeof(obj_id_t) * txn->num_objs);
+    pmhw_ctx_schedule(ctx, client_id, &full);
+    return;
+  }
+  pmlog_record(txn->id, PMLOG_SUBMIT, -1LLU);
+  txn_ring_commit(&ctx->pending_qs[client_id], txn);
+  pmwait_notify(ctx->wait_strategy, &ctx->shards[0].event);
+}
+
+/*
+Take up to max transactions from the first peer with a non-empty sched queue, at most half of
+what it has queued. Peers are the puppets of the same shard, whose scheduler does the bookkeeping.
+The steal notices reach the scheduler before any done report of the thief.
+Thieves only sleep on their own event, so with PMHW_WAIT_SLEEP they look for work
+to steal again after at most PMWAIT_SLEEP_NS.
+*/
+static int steal_scheduled(pmhw_ctx_t *ctx, int thief, txn_id_t *txn_ids, int max) {
+  sim_shard_t *shard = &ctx->shards[thief % ctx->num_shards];
+  for (int victim = next_puppet(shard, thief); victim != thief; victim = next_puppet(shard, victim)) {
+    int queued = spsc_tid_size(&ctx->sched_qs[victim]);
+    if (queued <= 0) continue;
+    int half = (queued + 1) / 2;
+    int n = spsc_tid_deq_batch_mc(&ctx->sched_qs[victim], txn_ids, half < max ? half : max);
+    if (n == 0) continue;
+    for (int i = 0; i < n; ++i) {
+      txn_id_t notice = txn_ids[i] | STEAL_NOTICE;
+      while (!spsc_tid_enq(&ctx->done_qs[thief], &notice)) pmwait_relax(ctx->wait_strategy);
+    }
+    pmwait_notify(ctx->wait_strategy, &shard->event);
+    return n;
+  }
+  return 0;
+}
+
+// Own queue first, then the peers'
+static int take_scheduled(pmhw_ctx_t *ctx, int puppet_id, txn_id_t *txn_ids, int max) {
+  if (!ctx->work_stealing) return spsc_tid_deq_batch(&ctx->sched_qs[puppet_id], txn_ids, max);
+  int n = spsc_tid_deq_batch_mc(&ctx->sched_qs[puppet_id], txn_ids, max);
+  return n > 0 ? n : steal_scheduled(ctx, puppet_id, txn_ids, max);
+}
+
+bool pmhw_ctx_poll_scheduled(pmhw_ctx_t *ctx, int puppet_id, txn_id_t *txn_id) {
   ASSERT(txn_id);
-  uint32_t cnt = 0;
-  while (cnt++ % (1<<RUNNING_CHECK_SHIFT) != 0 || atomic_load_explicit(&scheduler_running, memory_order_relaxed)) {
-    if (spsc_tid_deq(&sched_qs[puppet_id], txn_id)) return true;
+  return PMWAIT_UNTIL(ctx->wait_strategy, &ctx->puppet_events[puppet_id], &ctx->scheduler_running,
+                      take_scheduled(ctx, puppet_id, txn_id, 1) > 0);
+}
+
+void pmhw_ctx_report_done(pmhw_ctx_t *ctx, int puppet_id, txn_id_t txn_id) {
+  pmlog_record(txn_id, PMLOG_DONE, puppet_id);
+  // Done queues have room for every in-flight transaction, so this practically never waits
+  while (!spsc_tid_enq(&ctx->done_qs[puppet_id], &txn_id)) pmwait_relax(ctx->wait_strategy);
+  pmwait_notify(ctx->wait_strategy, &ctx->shards[puppet_id % ctx->num_shards].event);
+}
+
+void pmhw_ctx_schedule_batch(pmhw_ctx_t *ctx, int client_id, const txn_t *txns, int n) {
+  ASSERT(txns);
+  // Sharded, consecutive transactions usually go to different queues
+  if (ctx->num_shards > 1) {
+    for (int i = 0; i < n; ++i) pmhw_ctx_schedule(ctx, client_id, &txns[i]);
+    return;
   }
-  return false;
+  txn_id_t ids[64];
+  for (int i = 0; i < n; i += 64) {
+    int cnt = n - i < 64 ? n - i : 64;
+    for (int j = 0; j < cnt; ++j) ids[j] = txns[i + j].id;
+    pmlog_record_batch(ids, cnt, PMLOG_SUBMIT, -1LLU);
+  }
+  while (n > 0) {
+    int cnt = 0;
+    if (!PMWAIT_UNTIL(ctx->wait_strategy, &ctx->client_events[client_id], &ctx->scheduler_running,
+                      (cnt = txn_ring_enq_batch(&ctx->pending_qs[client_id], txns, n)) > 0)) return;
+    pmwait_notify(ctx->wait_strategy, &ctx->shards[0].event);
+    txns += cnt;
+    n -= cnt;
+  }
+}
+
+int pmhw_ctx_poll_scheduled_batch(pmhw_ctx_t *ctx, int puppet_id, txn_id_t *txn_ids, int max) {
+  ASSERT(txn_ids);
+  int n = 0;
+  PMWAIT_UNTIL(ctx->wait_strategy, &ctx->puppet_events[puppet_id], &ctx->scheduler_running,
+               (n = take_scheduled(ctx, puppet_id, txn_ids, max)) > 0);
+  return n;
+}
+
+void pmhw_ctx_report_done_batch(pmhw_ctx_t *ctx, int puppet_id, const txn_id_t *txn_ids, int n) {
+  ASSERT(txn_ids);
+  pmlog_record_batch(txn_ids, n, PMLOG_DONE, puppet_id);
+  while (n > 0) {
+    int cnt = spsc_tid_enq_batch(&ctx->done_qs[puppet_id], txn_ids, n);
+    if (cnt == 0) {
+      pmwait_relax(ctx->wait_strategy);
+      continue;
+    }
+    pmwait_notify(ctx->wait_strategy, &ctx->shards[puppet_id % ctx->num_shards].event);
+    txn_ids += cnt;
+    n -= cnt;
+  }
+}
+
+int pmhw_ctx_poll_aborted(pmhw_ctx_t *ctx, int client_id, txn_id_t *txn_ids, int max) {
+  ASSERT(txn_ids);
+  return spsc_tid_deq_batch(&ctx->abort_qs[client_id], txn_ids, max);
+}
+
+void pmhw_ctx_get_stats(pmhw_ctx_t *ctx, pmhw_stats_t *stats) {
+  ASSERT(stats);
+  stats->num_committed = atomic_load_explicit(&ctx->num_committed, memory_order_relaxed);
+  stats->num_aborted = atomic_load_explicit(&ctx->num_aborted, memory_order_relaxed);
+  stats->num_cross_shard = atomic_load_explicit(&ctx->num_cross_shard, memory_order_relaxed);
+  // Read false positives first, so they never exceed what was checked
+  stats->num_false_positives = atomic_load_explicit(&ctx->policy_counters.num_false_positives, memory_order_acquire);
+  stats->num_summary_checked = atomic_load_explicit(&ctx->policy_counters.num_summary_checked, memory_order_relaxed);
+  stats->num_true_conflicts = stats->num_summary_checked - stats->num_false_positives;
+
+  struct timespec now;
+  if (atomic_load_explicit(&ctx->scheduler_running, memory_order_acquire)) clock_gettime(CLOCK_MONOTONIC, &now);
+  else now = ctx->shutdown_time;
+  stats->elapsed = (now.tv_sec - ctx->init_time.tv_sec) + (now.tv_nsec - ctx->init_time.tv_nsec) * 1e-9;
+}
+
+/*
+The functions without a context argument work on a default context, which lives from pmhw_init
+until the next pmhw_init, so threads may still leave calls interrupted by pmhw_shutdown
+*/
+
+void pmhw_init(int num_clients, int num_puppets) {
+  pmhw_config_t config = pmhw_config_default(num_clients, num_puppets);
+  pmhw_init_ex(&config);
+}
+
+void pmhw_init_ex(const pmhw_config_t *config) {
+  pmhw_ctx_free(default_ctx);
+  default_ctx = pmhw_ctx_create(config);
+}
+
+void pmhw_shutdown() {
+  pmhw_ctx_shutdown(default_ctx);
+}
+
+pmhw_ctx_t *pmhw_default_ctx() {
+  return default_ctx;
+}
+
+void pmhw_schedule(int client_id, const txn_t *txn) {
+  pmhw_ctx_schedule(default_ctx, client_id, txn);
+}
+
+pmhw_status_t pmhw_try_schedule(int client_id, const txn_t *txn) {
+  return pmhw_ctx_try_schedule(default_ctx, client_id, txn);
+}
+
+int pmhw_queue_depth(int client_id) {
+  return pmhw_ctx_queue_depth(default_ctx, client_id);
+}
+
+packed_txn_t *pmhw_reserve_txn(int client_id) {
+  return pmhw_ctx_reserve_txn(default_ctx, client_id);
+}
+
+void pmhw_commit_txn(int client_id, packed_txn_t *txn) {
+  pmhw_ctx_commit_txn(default_ctx, client_id, txn);
+}
+
+bool pmhw_poll_scheduled(int puppet_id, txn_id_t *txn_id) {
+  return pmhw_ctx_poll_scheduled(default_ctx, puppet_id, txn_id);
 }
 
 void pmhw_report_done(int puppet_id, txn_id_t txn_id) {
-  pmlog_record(txn_id, PMLOG_DONE, puppet_id);
-  while (!spsc_tid_enq(&done_qs[puppet_id], &txn_id));
+  pmhw_ctx_report_done(default_ctx, puppet_id, txn_id);
+}
+
+void pmhw_schedule_batch(int client_id, const txn_t *txns, int n) {
+  pmhw_ctx_schedule_batch(default_ctx, client_id, txns, n);
 }
 
+int pmhw_poll_scheduled_batch(int puppet_id, txn_id_t *txn_ids, int max) {
+  return pmhw_ctx_poll_scheduled_batch(default_ctx, puppet_id, txn_ids, max);
+}
+
+void pmhw_report_done_batch(int puppet_id, const txn_id_t *txn_ids, int n) {
+  pmhw_ctx_report_done_batch(default_ctx, puppet_id, txn_ids, n);
+}
+
+int pmhw_poll_aborted(int client_id, txn_id_t *txn_ids, int max) {
+  return pmhw_ctx_poll_aborted(default_ctx, client_id, txn_ids, max);
+}
+
+void pmhw_get_stats(pmhw_stats_t *stats) {
+  pmhw_ctx_get_stats(default_ctx, stats);
+}
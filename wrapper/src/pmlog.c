@@ -54,6 +54,7 @@ static const char *kind_to_str(pmlog_kind_t k) {
     case PMLOG_WORK_RECV:   return "executing";
     case PMLOG_DONE:        return "done";
     case PMLOG_CLEANUP:     return "removed";
+    case PMLOG_ABORT:       return "aborted";
   }
   ASSERT(false);
 }
@@ -64,6 +65,8 @@ static void dump_event_human(FILE *dst, const pmlog_evt_t *e) {
   fprintf(dst, "[+%.8f] txn_id=%" PRIu64 " %s", us, e->txn_id, kind_to_str(e->kind));
   if (e->kind == PMLOG_SCHED_READY || e->kind == PMLOG_WORK_RECV || e->kind == PMLOG_DONE) {
     fprintf(dst, " on puppet_id=%" PRIu64, e->aux_data);
+  } else if (e->kind == PMLOG_ABORT) {
+    fprintf(dst, " back to client_id=%" PRIu64, e->aux_data);
   }
   fputc('\n', dst);
   pthread_mutex_unlock(&live_dump_mutex);
@@ -75,7 +78,8 @@ void pmlog_record(txn_id_t txn_id, pmlog_kind_t kind, uint64_t aux_data) {
 
   unsigned int _; // unused temp variable for rdtscp
   int i = atomic_fetch_add_explicit(&num_events, 1, memory_order_relaxed);
-  // ASSERTF(i < max_num_events, "got %d expected < %d", num_events, max_num_events);
+  // Retried (aborted) transactions log more events than planned for; drop what does not fit
+  if (i >= max_num_events) return;
 
   pmlog_evt_buf[i] = (pmlog_evt_t){ __rdtscp(&_), txn_id, kind, aux_data };
 
@@ -85,6 +89,24 @@ void pmlog_record(txn_id_t txn_id, pmlog_kind_t kind, uint64_t aux_data) {
   }
 }
 
+void pmlog_record_batch(const txn_id_t *txn_ids, int n, pmlog_kind_t kind, uint64_t aux_data) {
+  if (sample_period == 0) return;
+  int num_sampled = 0;
+  for (int j = 0; j < n; ++j) num_sampled += txn_ids[j] % sample_period == 0;
+  if (num_sampled == 0) return;
+
+  unsigned int _; // unused temp variable for rdtscp
+  uint64_t tsc = __rdtscp(&_);
+  int i = atomic_fetch_add_explicit(&num_events, num_sampled, memory_order_relaxed);
+  for (int j = 0; j < n && i < max_num_events; ++j) {
+    if (txn_ids[j] % sample_period != 0) continue;
+    pmlog_evt_buf[i] = (pmlog_evt_t){ tsc, txn_ids[j], kind, aux_data };
+    if (live_dump) dump_event_human(live_dump, &pmlog_evt_buf[i]);
+    ++i;
+  }
+  if (live_dump) fflush(live_dump);
+}
+
 void pmlog_start_timer(double _cpu_freq) {
   unsigned int _; // unused temp variable for rdtscp
   base_tsc = __rdtscp(&_);
@@ -99,12 +121,23 @@ static int compare_events(const void *a, const void *b) {
   return 0;
 }
 
+// Number of events actually in the buffer
+static int num_logged() {
+  int n = atomic_load_explicit(&num_events, memory_order_relaxed);
+  if (n > max_num_events) {
+    WARN("Log full, dropped the last %d events", n - max_num_events);
+    n = max_num_events;
+  }
+  return n;
+}
+
 void pmlog_write(FILE *f) {
-  qsort(pmlog_evt_buf, num_events, sizeof(pmlog_evt_t), compare_events);
-  fwrite(&num_events, sizeof(int), 1, f);
+  int n = num_logged();
+  qsort(pmlog_evt_buf, n, sizeof(pmlog_evt_t), compare_events);
+  fwrite(&n, sizeof(int), 1, f);
   fwrite(&base_tsc, sizeof(uint64_t), 1, f);
   fwrite(&cpu_freq, sizeof(double), 1, f);
-  fwrite(pmlog_evt_buf, sizeof(pmlog_evt_t), num_events, f);
+  fwrite(pmlog_evt_buf, sizeof(pmlog_evt_t), n, f);
 }
 
 int pmlog_read(FILE *f, double *_cpu_freq, uint64_t *_base_tsc) {
@@ -122,8 +155,9 @@ int pmlog_read(FILE *f, double *_cpu_freq, uint64_t *_base_tsc) {
 }
 
 void pmlog_dump_text(FILE *f) {
-  qsort(pmlog_evt_buf, num_events, sizeof(pmlog_evt_t), compare_events);
-  for (int i = 0; i < (int)atomic_load_explicit(&num_events, memory_order_relaxed); ++i) {
+  int n = num_logged();
+  qsort(pmlog_evt_buf, n, sizeof(pmlog_evt_t), compare_events);
+  for (int i = 0; i < n; ++i) {
     dump_event_human(f, &pmlog_evt_buf[i]);
   }
 }
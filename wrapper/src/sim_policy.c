@@ -0,0 +1,800 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#include "pmhw.h"
+#include "pmutils.h"
+#include "sim_policy.h"
+#include "lock_table.h"
+#include "bloom.h"
+
+// Set to 1 to let the Bloom policy summarize reads and writes together like Summary.bsv,
+// instead of in separate filters
+#ifndef SIM_BLOOM_UNIFIED
+#define SIM_BLOOM_UNIFIED 0
+#endif
+
+// Set to 1 to hash whole transactions with the AVX2 kernels of bloom.h instead of object by object.
+// bloom_bench shows them faster on large object pools but slower on small, contended ones.
+#ifndef SIM_BLOOM_TXN_KERNELS
+#define SIM_BLOOM_TXN_KERNELS 0
+#endif
+
+// Nanoseconds between swaps of the main and shadow Bloom summaries. Like RefreshDuration in
+// Puppetmaster.bsv this is elapsed time, not a count of checks or admissions. The hardware's 512
+// cycles are 2 us at 250 MHz, about what clearing and refilling a software summary costs, so the
+// default is 50 times longer to keep swaps a small part of the scheduler's time.
+#ifndef SIM_BLOOM_REFRESH_NS
+#define SIM_BLOOM_REFRESH_NS 100000
+#endif
+
+// Nanoseconds a swap keeps the summary from admitting anything, like the StartSwitch and Switching
+// states that pause the lookahead. The hardware spends about 24 of its 512 cycles there (the shadow
+// catching up on up to 16 active transactions, then copying 8 chunks); this keeps that share.
+#ifndef SIM_BLOOM_REFRESH_STALL_NS
+#define SIM_BLOOM_REFRESH_STALL_NS (SIM_BLOOM_REFRESH_NS * 24 / 512)
+#endif
+
+// Number of pending transactions per client the scheduler may consider out of order,
+// like LookaheadBufferSize in Puppetmaster.bsv. 1 means strictly in order.
+#ifndef SIM_LOOKAHEAD_SIZE
+#define SIM_LOOKAHEAD_SIZE 4
+#endif
+
+// How many younger transactions may be scheduled ahead of a conflicting one
+// before it blocks the rest of the window, so it cannot starve.
+#ifndef SIM_LOOKAHEAD_MAX_BYPASS
+#define SIM_LOOKAHEAD_MAX_BYPASS 16
+#endif
+
+// Pending transactions per client that make up one batch of the coloring policy
+#ifndef SIM_COLORING_WINDOW
+#define SIM_COLORING_WINDOW 16
+#endif
+
+// Held-back transactions of the Bloom policies are checked against the exact active set to tell
+// real conflicts from false positives (pmhw_get_stats). One in 2^S gets checked and counts for 2^S,
+// since each check scans the whole active set; -1 turns it off.
+#ifndef SIM_BLOOM_FP_SAMPLE_SHIFT
+#define SIM_BLOOM_FP_SAMPLE_SHIFT 6
+#endif
+
+// log2 of the number of entries in the commit table of the optimistic policy.
+// Objects that share an entry look like the same object, which can only cause extra aborts.
+#ifndef SIM_OPTIMISTIC_TABLE_BITS
+#define SIM_OPTIMISTIC_TABLE_BITS 16
+#endif
+
+/*
+Exact conflict checks through reader/writer locks of all active transactions,
+so a check only costs O(objs). Used in order (exact) and with a lookahead window (lookahead).
+*/
+typedef struct {
+  lock_table_t locks;
+} lock_policy_t;
+
+static void *lock_create(const sim_view_t *view) {
+  lock_policy_t *st = (lock_policy_t *) malloc(sizeof(lock_policy_t));
+  ASSERT(st);
+  // Keep the table at most half full even if every active transaction holds distinct objects
+  int capacity = 1;
+  while (capacity < 2 * view->num_puppets * view->active_per_puppet * MAX_TXN_OBJS) capacity <<= 1;
+  lock_table_init(&st->locks, capacity);
+  return st;
+}
+
+static void lock_destroy(void *state) {
+  lock_policy_t *st = (lock_policy_t *) state;
+  lock_table_free(&st->locks);
+  free(st);
+}
+
+static bool lock_admit(void *state, const txn_t *txn) {
+  return !lock_table_check(&((lock_policy_t *) state)->locks, txn);
+}
+
+static void lock_on_schedule(void *state, const txn_t *txn) {
+  lock_table_acquire(&((lock_policy_t *) state)->locks, txn);
+}
+
+static void lock_on_complete(void *state, const txn_t *txn) {
+  lock_table_release(&((lock_policy_t *) state)->locks, txn);
+}
+
+static const sim_policy_t exact_policy = {
+  .name = "exact",
+  .window = 1,
+  .max_bypass = 0,
+  .create = lock_create,
+  .destroy = lock_destroy,
+  .admit = lock_admit,
+  .on_schedule = lock_on_schedule,
+  .on_complete = lock_on_complete,
+};
+
+static const sim_policy_t lookahead_policy = {
+  .name = "lookahead",
+  .window = SIM_LOOKAHEAD_SIZE,
+  .max_bypass = SIM_LOOKAHEAD_MAX_BYPASS,
+  .create = lock_create,
+  .destroy = lock_destroy,
+  .admit = lock_admit,
+  .on_schedule = lock_on_schedule,
+  .on_complete = lock_on_complete,
+};
+
+/*
+Bloom summary of active objects, like the hardware. The main summary answers conflict checks.
+Unlike checkOrAddToChunk in Summary.bsv, reads and writes are kept apart (bloom_rw_t),
+so transactions that only share reads run concurrently, unless SIM_BLOOM_UNIFIED is set.
+Completed transactions stay in the summaries. As in mkPuppetmaster, scheduled transactions go into
+both the main and the shadow summary, and every SIM_BLOOM_REFRESH_NS the shadow becomes the main
+summary while the old main one is cleared and refilled from the active list as the new shadow.
+Bits of a completed transaction are thus gone after at most two swaps. Each swap refuses all
+checks for SIM_BLOOM_REFRESH_STALL_NS.
+The clock is read once per scheduling pass that has candidates, so how often the scheduler
+retries stalled transactions does not change the cadence. Swaps that fell due while nothing was
+waiting are caught up at the next such pass; two leave the same summaries as any more.
+The hardware walks the active list in the background after the swap, while this refills the
+shadow at once, so it can skip a few more completed transactions.
+*/
+typedef struct {
+  const sim_view_t *view;
+  bloom_rw_t summaries[2];
+  bloom_rw_t *main_summary;
+  bloom_rw_t *shadow_summary;
+  uint64_t now;                 // CLOCK_MONOTONIC ns at the start of the current pass
+  uint64_t next_swap;           // when the refresh timer expires
+  uint64_t stall_until;         // end of the current swap's pause
+  bool swap_refused;            // the last check was refused by a swap rather than by the summary
+  uint64_t num_stalled;         // held-back transactions, to pick samples for false-positive accounting
+  uint64_t num_swaps;
+} bloom_policy_t;
+
+// Unified summaries treat every access as a write, which puts it in the write filter only
+static void summary_add(bloom_rw_t *bf, const txn_t *txn) {
+#if SIM_BLOOM_TXN_KERNELS
+  bloom_rw_insert_txn(bf, txn, SIM_BLOOM_UNIFIED);
+#else
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    bloom_rw_insert(bf, txn->objs[i] & ~(1ULL << 63), SIM_BLOOM_UNIFIED || obj_is_write(txn->objs[i]));
+  }
+#endif
+}
+
+static bool summary_check(const bloom_rw_t *bf, const txn_t *txn) {
+#if SIM_BLOOM_TXN_KERNELS
+  return bloom_rw_query_txn(bf, txn, SIM_BLOOM_UNIFIED);
+#else
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    if (bloom_rw_query(bf, txn->objs[i] & ~(1ULL << 63), SIM_BLOOM_UNIFIED || obj_is_write(txn->objs[i]))) return true;
+  }
+  return false;
+#endif
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void swap_summaries(bloom_policy_t *st) {
+  const active_set_t *active = st->view->active;
+  bloom_rw_t *tmp = st->main_summary;
+  st->main_summary = st->shadow_summary;
+  st->shadow_summary = tmp;
+  bloom_rw_init(st->shadow_summary);
+  for (int slot = active_set_next(active, 0); slot >= 0; slot = active_set_next(active, slot+1)) {
+    summary_add(st->shadow_summary, &active->slots[slot].txn);
+  }
+  st->num_swaps++;
+}
+
+static void *bloom_create(const sim_view_t *view) {
+  bloom_policy_t *st = (bloom_policy_t *) calloc(1, sizeof(bloom_policy_t));
+  ASSERT(st);
+  st->view = view;
+  st->main_summary = &st->summaries[0];
+  st->shadow_summary = &st->summaries[1];
+  bloom_rw_init(st->main_summary);
+  bloom_rw_init(st->shadow_summary);
+  st->next_swap = now_ns() + SIM_BLOOM_REFRESH_NS;
+  return st;
+}
+
+static void bloom_destroy(void *state) {
+  free(state);
+}
+
+static void bloom_begin_pass(void *state, const txn_t *const *candidates, int n) {
+  bloom_policy_t *st = (bloom_policy_t *) state;
+  (void)candidates;
+  if (n == 0) return;
+  st->now = now_ns();
+  if (st->now < st->next_swap) return;
+  swap_summaries(st);
+  if (st->now - st->next_swap >= SIM_BLOOM_REFRESH_NS) swap_summaries(st);
+  // The timer restarts once the switch is done
+  st->stall_until = st->now + SIM_BLOOM_REFRESH_STALL_NS;
+  st->next_swap = st->stall_until + SIM_BLOOM_REFRESH_NS;
+}
+
+static bool bloom_admit(void *state, const txn_t *txn) {
+  bloom_policy_t *st = (bloom_policy_t *) state;
+  st->swap_refused = st->now < st->stall_until;
+  if (st->swap_refused) return false;
+  return !summary_check(st->main_summary, txn);
+}
+
+#if SIM_BLOOM_FP_SAMPLE_SHIFT >= 0
+// Exact scan over the active list, only used to classify Bloom hits
+static bool conflicts_with_active(const sim_view_t *view, const txn_t *txn) {
+  const active_set_t *active = view->active;
+  for (int slot = active_set_next(active, 0); slot >= 0; slot = active_set_next(active, slot+1)) {
+    if (check_txn_conflict(txn, &active->slots[slot].txn)) return true;
+  }
+  return false;
+}
+#endif
+
+// Classify a sample of the transactions a summary held back as real conflicts or false positives
+static void account_stall(const sim_view_t *view, const txn_t *txn, uint64_t *num_stalled) {
+#if SIM_BLOOM_FP_SAMPLE_SHIFT >= 0
+  if ((*num_stalled)++ & ((1ull << SIM_BLOOM_FP_SAMPLE_SHIFT) - 1)) return;
+  bool false_positive = !conflicts_with_active(view, txn);
+  uint64_t weight = 1ull << SIM_BLOOM_FP_SAMPLE_SHIFT;
+  atomic_fetch_add_explicit(&view->counters->num_summary_checked, weight, memory_order_relaxed);
+  // After the check count, so readers never see more false positives than checks
+  if (false_positive) atomic_fetch_add_explicit(&view->counters->num_false_positives, weight, memory_order_release);
+#endif
+}
+
+static void bloom_on_stall(void *state, const txn_t *txn) {
+  bloom_policy_t *st = (bloom_policy_t *) state;
+  // Only summary hits can be false positives
+  if (!st->swap_refused) account_stall(st->view, txn, &st->num_stalled);
+}
+
+static void bloom_on_schedule(void *state, const txn_t *txn) {
+  bloom_policy_t *st = (bloom_policy_t *) state;
+  summary_add(st->main_summary, txn);
+  summary_add(st->shadow_summary, txn);
+}
+
+// Completed transactions leave the summaries only through swaps
+static void bloom_on_complete(void *state, const txn_t *txn) {
+  (void)state;
+  (void)txn;
+}
+
+static void bloom_report(void *state) {
+  bloom_policy_t *st = (bloom_policy_t *) state;
+  INFO("Bloom policy: %lu summary swaps", st->num_swaps);
+}
+
+static const sim_policy_t bloom_policy = {
+  .name = "bloom",
+  .window = SIM_LOOKAHEAD_SIZE,
+  .max_bypass = SIM_LOOKAHEAD_MAX_BYPASS,
+  .create = bloom_create,
+  .destroy = bloom_destroy,
+  .begin_pass = bloom_begin_pass,
+  .admit = bloom_admit,
+  .on_stall = bloom_on_stall,
+  .on_schedule = bloom_on_schedule,
+  .on_complete = bloom_on_complete,
+  .report = bloom_report,
+};
+
+/*
+Counting Bloom summary: completed transactions are removed right away, so there is nothing
+to refresh and no point where scheduling waits for a rebuild. Only counters that saturated
+are sticky; once any did, a hit triggers a rebuild from the active list.
+*/
+typedef struct {
+  const sim_view_t *view;
+  bloom_count_rw_t summary;
+  int num_saturated;            // counters stuck since the last rebuild
+  uint64_t num_stalled;
+  uint64_t num_rebuilds;
+} counting_policy_t;
+
+static void counting_add(counting_policy_t *st, const txn_t *txn) {
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    st->num_saturated += bloom_count_rw_insert(&st->summary, txn->objs[i] & ~(1ULL << 63),
+                                               SIM_BLOOM_UNIFIED || obj_is_write(txn->objs[i]));
+  }
+}
+
+static bool counting_check(const counting_policy_t *st, const txn_t *txn) {
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    if (bloom_count_rw_query(&st->summary, txn->objs[i] & ~(1ULL << 63), SIM_BLOOM_UNIFIED || obj_is_write(txn->objs[i]))) return true;
+  }
+  return false;
+}
+
+static void counting_rebuild(counting_policy_t *st) {
+  const active_set_t *active = st->view->active;
+  bloom_count_rw_init(&st->summary);
+  st->num_saturated = 0;
+  for (int slot = active_set_next(active, 0); slot >= 0; slot = active_set_next(active, slot+1)) {
+    counting_add(st, &active->slots[slot].txn);
+  }
+  st->num_rebuilds++;
+}
+
+static void *counting_create(const sim_view_t *view) {
+  counting_policy_t *st = (counting_policy_t *) calloc(1, sizeof(counting_policy_t));
+  ASSERT(st);
+  st->view = view;
+  bloom_count_rw_init(&st->summary);
+  return st;
+}
+
+static void counting_destroy(void *state) {
+  free(state);
+}
+
+static bool counting_admit(void *state, const txn_t *txn) {
+  counting_policy_t *st = (counting_policy_t *) state;
+  bool conflict = counting_check(st, txn);
+  if (conflict && st->num_saturated > 0) {
+    counting_rebuild(st);
+    conflict = counting_check(st, txn);
+  }
+  return !conflict;
+}
+
+static void counting_on_stall(void *state, const txn_t *txn) {
+  counting_policy_t *st = (counting_policy_t *) state;
+  account_stall(st->view, txn, &st->num_stalled);
+}
+
+static void counting_on_schedule(void *state, const txn_t *txn) {
+  counting_add((counting_policy_t *) state, txn);
+}
+
+static void counting_on_complete(void *state, const txn_t *txn) {
+  counting_policy_t *st = (counting_policy_t *) state;
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    bloom_count_rw_remove(&st->summary, txn->objs[i] & ~(1ULL << 63), SIM_BLOOM_UNIFIED || obj_is_write(txn->objs[i]));
+  }
+}
+
+static void counting_report(void *state) {
+  counting_policy_t *st = (counting_policy_t *) state;
+  INFO("Counting Bloom policy: %lu rebuilds after saturation", st->num_rebuilds);
+}
+
+static const sim_policy_t counting_policy = {
+  .name = "counting",
+  .window = SIM_LOOKAHEAD_SIZE,
+  .max_bypass = SIM_LOOKAHEAD_MAX_BYPASS,
+  .create = counting_create,
+  .destroy = counting_destroy,
+  .admit = counting_admit,
+  .on_stall = counting_on_stall,
+  .on_schedule = counting_on_schedule,
+  .on_complete = counting_on_complete,
+  .report = counting_report,
+};
+
+/*
+Batch coloring: once the previous batch has finished, take everything that is waiting,
+color its conflict graph into rounds of mutually compatible transactions, and run one round at a time.
+A round starts when every transaction of the previous one has completed, so rounds never
+conflict with what is active. The rounds come from repeatedly applying one of the schedulers
+of model/scheduler.py to whatever is not assigned yet:
+- coloring: GreedyScheduler, which amounts to greedy coloring in priority order.
+- tournament: TournamentScheduler, merging neighbours pairwise.
+*/
+typedef struct {
+  txn_id_t id;
+  int round;
+} batch_member_t;
+
+// A merged transaction of the tournament: members and sorted, duplicate-free objects in an arena
+typedef struct {
+  int first_member, num_members;
+  int first_obj, num_objs;
+} tgroup_t;
+
+typedef struct {
+  bool tournament;
+  batch_member_t *members;  // sorted by id
+  int len;
+  int *colors;              // scratch for coloring
+  int *stamp;
+  tgroup_t *groups[2];      // scratch for the tournament, one arena per level parity
+  int *group_members[2];
+  obj_id_t *group_objs[2];
+  int cur_round;
+  int num_rounds;
+  int round_left;           // members of the current round not dispatched yet
+  int round_active;         // members of the current round dispatched but not completed
+  uint64_t num_batches;
+  uint64_t total_rounds;
+  uint64_t total_members;
+} coloring_policy_t;
+
+static int compare_member(const void *a, const void *b) {
+  txn_id_t x = ((const batch_member_t *) a)->id, y = ((const batch_member_t *) b)->id;
+  return (x > y) - (x < y);
+}
+
+static const batch_member_t *coloring_find(const coloring_policy_t *st, txn_id_t id) {
+  int lo = 0, hi = st->len;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (st->members[mid].id < id) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo < st->len && st->members[lo].id == id ? &st->members[lo] : NULL;
+}
+
+// Move on to the next round whenever the current one is fully done
+static void coloring_advance(coloring_policy_t *st) {
+  while (st->round_left == 0 && st->round_active == 0 && st->cur_round < st->num_rounds) {
+    st->cur_round++;
+    for (int i = 0; i < st->len; ++i) st->round_left += st->members[i].round == st->cur_round;
+  }
+}
+
+static void *coloring_create(const sim_view_t *view, bool tournament) {
+  coloring_policy_t *st = (coloring_policy_t *) calloc(1, sizeof(coloring_policy_t));
+  ASSERT(st);
+  int capacity = view->num_clients * SIM_COLORING_WINDOW;
+  st->tournament = tournament;
+  st->members = (batch_member_t *) malloc(sizeof(batch_member_t) * capacity);
+  st->colors = (int *) malloc(sizeof(int) * capacity);
+  st->stamp = (int *) malloc(sizeof(int) * capacity);
+  ASSERT(st->members && st->colors && st->stamp);
+  if (tournament) {
+    for (int k = 0; k < 2; ++k) {
+      st->groups[k] = (tgroup_t *) malloc(sizeof(tgroup_t) * capacity);
+      st->group_members[k] = (int *) malloc(sizeof(int) * capacity);
+      st->group_objs[k] = (obj_id_t *) malloc(sizeof(obj_id_t) * capacity * MAX_TXN_OBJS);
+      ASSERT(st->groups[k] && st->group_members[k] && st->group_objs[k]);
+    }
+  }
+  return st;
+}
+
+static void *greedy_create(const sim_view_t *view) {
+  return coloring_create(view, false);
+}
+
+static void *tournament_create(const sim_view_t *view) {
+  return coloring_create(view, true);
+}
+
+static void coloring_destroy(void *state) {
+  coloring_policy_t *st = (coloring_policy_t *) state;
+  free(st->members);
+  free(st->colors);
+  free(st->stamp);
+  for (int k = 0; k < 2; ++k) {
+    free(st->groups[k]);
+    free(st->group_members[k]);
+    free(st->group_objs[k]);
+  }
+  free(st);
+}
+
+// Greedy coloring: each transaction gets the lowest color none of its conflicting predecessors has
+static int color_greedy(coloring_policy_t *st, const txn_t *const *candidates, int n) {
+  int num_colors = 0;
+  for (int i = 0; i < n; ++i) st->stamp[i] = -1;
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < i; ++j) {
+      if (check_txn_conflict(candidates[i], candidates[j])) st->stamp[st->colors[j]] = i;
+    }
+    int color = 0;
+    while (st->stamp[color] == i) color++;
+    st->colors[i] = color;
+    if (color + 1 > num_colors) num_colors = color + 1;
+  }
+  return num_colors;
+}
+
+static int compare_obj(const void *a, const void *b) {
+  obj_id_t x = *(const obj_id_t *) a & ~(1ULL << 63), y = *(const obj_id_t *) b & ~(1ULL << 63);
+  return (x > y) - (x < y);
+}
+
+// Transaction.compat over sorted object lists
+static bool objs_compat(const obj_id_t *a, int na, const obj_id_t *b, int nb) {
+  int i = 0, j = 0;
+  while (i < na && j < nb) {
+    obj_id_t x = a[i] & ~(1ULL << 63), y = b[j] & ~(1ULL << 63);
+    if (x < y) i++;
+    else if (y < x) j++;
+    else if (obj_is_write(a[i]) || obj_is_write(b[j])) return false;
+    else { i++; j++; }
+  }
+  return true;
+}
+
+// Transaction.merge over sorted object lists: the union, where a write wins over a read
+static int objs_merge(const obj_id_t *a, int na, const obj_id_t *b, int nb, obj_id_t *out) {
+  int i = 0, j = 0, n = 0;
+  while (i < na || j < nb) {
+    obj_id_t x = i < na ? a[i] & ~(1ULL << 63) : UINT64_MAX;
+    obj_id_t y = j < nb ? b[j] & ~(1ULL << 63) : UINT64_MAX;
+    if (x < y) out[n++] = a[i++];
+    else if (y < x) out[n++] = b[j++];
+    else out[n++] = a[i++] | b[j++];
+  }
+  return n;
+}
+
+/*
+Tournament: neighbours are paired up, and each pair merges into one group if compatible,
+otherwise the left one goes on alone. Python insists on a power of two; here the last group
+of an odd level goes on unpaired, as if paired with an empty transaction.
+The winner always contains the oldest unassigned transaction, so every tournament makes progress.
+*/
+static int color_tournament(coloring_policy_t *st, const txn_t *const *candidates, int n) {
+  for (int i = 0; i < n; ++i) st->colors[i] = -1;
+  int num_assigned = 0;
+  int round = 0;
+  while (num_assigned < n) {
+    // One group per unassigned transaction, with its objects sorted and deduplicated
+    int cur = 0, num_groups = 0, num_members = 0, num_objs = 0;
+    for (int i = 0; i < n; ++i) {
+      if (st->colors[i] >= 0) continue;
+      tgroup_t *g = &st->groups[cur][num_groups++];
+      obj_id_t *objs = &st->group_objs[cur][num_objs];
+      int len = 0;
+      for (int k = 0; k < (int)candidates[i]->num_objs; ++k) objs[len++] = candidates[i]->objs[k];
+      qsort(objs, len, sizeof(obj_id_t), compare_obj);
+      int uniq = 0;
+      for (int k = 0; k < len; ++k) {
+        if (uniq > 0 && compare_obj(&objs[uniq-1], &objs[k]) == 0) objs[uniq-1] |= objs[k];
+        else objs[uniq++] = objs[k];
+      }
+      *g = (tgroup_t){ num_members, 1, num_objs, uniq };
+      st->group_members[cur][num_members++] = i;
+      num_objs += uniq;
+    }
+
+    // Play levels until one group is left
+    while (num_groups > 1) {
+      int next = !cur, next_groups = 0, next_members = 0, next_objs = 0;
+      for (int k = 0; k < num_groups; k += 2) {
+        const tgroup_t *g1 = &st->groups[cur][k];
+        const tgroup_t *g2 = k + 1 < num_groups ? &st->groups[cur][k+1] : NULL;
+        const obj_id_t *objs1 = &st->group_objs[cur][g1->first_obj];
+        bool merge = g2 && objs_compat(objs1, g1->num_objs, &st->group_objs[cur][g2->first_obj], g2->num_objs);
+
+        tgroup_t *out = &st->groups[next][next_groups++];
+        out->first_member = next_members;
+        out->first_obj = next_objs;
+        memcpy(&st->group_members[next][next_members], &st->group_members[cur][g1->first_member], sizeof(int) * g1->num_members);
+        next_members += g1->num_members;
+        if (merge) {
+          memcpy(&st->group_members[next][next_members], &st->group_members[cur][g2->first_member], sizeof(int) * g2->num_members);
+          next_members += g2->num_members;
+          out->num_objs = objs_merge(objs1, g1->num_objs, &st->group_objs[cur][g2->first_obj], g2->num_objs,
+                                     &st->group_objs[next][next_objs]);
+        } else {
+          memcpy(&st->group_objs[next][next_objs], objs1, sizeof(obj_id_t) * g1->num_objs);
+          out->num_objs = g1->num_objs;
+        }
+        out->num_members = next_members - out->first_member;
+        next_objs += out->num_objs;
+      }
+      cur = next;
+      num_groups = next_groups;
+    }
+
+    // The winner makes up this round
+    const tgroup_t *winner = &st->groups[cur][0];
+    for (int k = 0; k < winner->num_members; ++k) {
+      st->colors[st->group_members[cur][winner->first_member + k]] = round;
+    }
+    num_assigned += winner->num_members;
+    round++;
+  }
+  return round;
+}
+
+static void coloring_begin_pass(void *state, const txn_t *const *candidates, int n) {
+  coloring_policy_t *st = (coloring_policy_t *) state;
+  if (st->cur_round < st->num_rounds || n == 0) return; // previous batch still running
+
+  int num_colors = st->tournament ? color_tournament(st, candidates, n) : color_greedy(st, candidates, n);
+
+  st->len = n;
+  st->round_left = 0;
+  for (int i = 0; i < n; ++i) {
+    st->members[i] = (batch_member_t){ candidates[i]->id, st->colors[i] };
+    st->round_left += st->colors[i] == 0;
+  }
+  qsort(st->members, n, sizeof(batch_member_t), compare_member);
+  st->cur_round = 0;
+  st->num_rounds = num_colors;
+  st->round_active = 0;
+
+  st->num_batches++;
+  st->total_rounds += num_colors;
+  st->total_members += n;
+}
+
+static bool coloring_admit(void *state, const txn_t *txn) {
+  coloring_policy_t *st = (coloring_policy_t *) state;
+  const batch_member_t *m = coloring_find(st, txn->id);
+  return m && m->round == st->cur_round && st->cur_round < st->num_rounds;
+}
+
+static void coloring_on_schedule(void *state, const txn_t *txn) {
+  coloring_policy_t *st = (coloring_policy_t *) state;
+  (void)txn;
+  st->round_left--;
+  st->round_active++;
+}
+
+static void coloring_on_complete(void *state, const txn_t *txn) {
+  coloring_policy_t *st = (coloring_policy_t *) state;
+  (void)txn;
+  ASSERT(st->round_active > 0);
+  st->round_active--;
+  coloring_advance(st);
+}
+
+static void coloring_report(void *state) {
+  coloring_policy_t *st = (coloring_policy_t *) state;
+  if (st->num_batches == 0) return;
+  INFO("%s policy: %lu batches, %.2f rounds per batch, %.2f txns per round",
+       st->tournament ? "Tournament" : "Coloring", st->num_batches, (double) st->total_rounds / st->num_batches,
+       (double) st->total_members / st->total_rounds);
+}
+
+static const sim_policy_t coloring_policy = {
+  .name = "coloring",
+  .window = SIM_COLORING_WINDOW,
+  .max_bypass = INT_MAX,
+  .create = greedy_create,
+  .destroy = coloring_destroy,
+  .begin_pass = coloring_begin_pass,
+  .admit = coloring_admit,
+  .on_schedule = coloring_on_schedule,
+  .on_complete = coloring_on_complete,
+  .report = coloring_report,
+};
+
+static const sim_policy_t tournament_policy = {
+  .name = "tournament",
+  .window = SIM_COLORING_WINDOW,
+  .max_bypass = INT_MAX,
+  .create = tournament_create,
+  .destroy = coloring_destroy,
+  .begin_pass = coloring_begin_pass,
+  .admit = coloring_admit,
+  .on_schedule = coloring_on_schedule,
+  .on_complete = coloring_on_complete,
+  .report = coloring_report,
+};
+
+/*
+Optimistic: dispatch everything right away and validate at completion instead.
+Commits are numbered, and a table remembers per object the last commit that wrote it
+and the last one that accessed it at all. A transaction may commit only if no transaction
+that committed since it was dispatched wrote what it accesses or accessed what it writes.
+Any two committed transactions that overlapped are thus compatible.
+*/
+typedef struct {
+  const sim_view_t *view;
+  uint64_t *start;          // per active slot: number of commits when it was dispatched
+  uint64_t *last_write;     // per table entry: last commit that wrote it
+  uint64_t *last_access;    // per table entry: last commit that read or wrote it
+  uint64_t num_commits;
+  uint64_t num_aborts;
+} optimistic_policy_t;
+
+static inline int optimistic_entry(obj_id_t obj) {
+  return (int)(((obj & ~(1ULL << 63)) * 0x9e3779b97f4a7c15ull) >> (64 - SIM_OPTIMISTIC_TABLE_BITS));
+}
+
+static void *optimistic_create(const sim_view_t *view) {
+  optimistic_policy_t *st = (optimistic_policy_t *) calloc(1, sizeof(optimistic_policy_t));
+  ASSERT(st);
+  st->view = view;
+  st->start = (uint64_t *) malloc(sizeof(uint64_t) * view->active->capacity);
+  st->last_write = (uint64_t *) calloc(1 << SIM_OPTIMISTIC_TABLE_BITS, sizeof(uint64_t));
+  st->last_access = (uint64_t *) calloc(1 << SIM_OPTIMISTIC_TABLE_BITS, sizeof(uint64_t));
+  ASSERT(st->start && st->last_write && st->last_access);
+  return st;
+}
+
+static void optimistic_destroy(void *state) {
+  optimistic_policy_t *st = (optimistic_policy_t *) state;
+  free(st->start);
+  free(st->last_write);
+  free(st->last_access);
+  free(st);
+}
+
+static bool optimistic_admit(void *state, const txn_t *txn) {
+  (void)state;
+  (void)txn;
+  return true;
+}
+
+static void optimistic_on_schedule(void *state, const txn_t *txn) {
+  optimistic_policy_t *st = (optimistic_policy_t *) state;
+  st->start[active_set_find(st->view->active, txn->id)] = st->num_commits;
+}
+
+static bool optimistic_validate(void *state, const txn_t *txn) {
+  optimistic_policy_t *st = (optimistic_policy_t *) state;
+  uint64_t start = st->start[active_set_find(st->view->active, txn->id)];
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    int e = optimistic_entry(txn->objs[i]);
+    uint64_t last = obj_is_write(txn->objs[i]) ? st->last_access[e] : st->last_write[e];
+    if (last > start) {
+      st->num_aborts++;
+      return false;
+    }
+  }
+
+  uint64_t seq = ++st->num_commits;
+  for (int i = 0; i < (int)txn->num_objs; ++i) {
+    int e = optimistic_entry(txn->objs[i]);
+    st->last_access[e] = seq;
+    if (obj_is_write(txn->objs[i])) st->last_write[e] = seq;
+  }
+  return true;
+}
+
+static void optimistic_on_complete(void *state, const txn_t *txn) {
+  (void)state;
+  (void)txn;
+}
+
+static void optimistic_report(void *state) {
+  optimistic_policy_t *st = (optimistic_policy_t *) state;
+  uint64_t attempts = st->num_commits + st->num_aborts;
+  INFO("Optimistic policy: %lu commits, %lu aborts (%.2f%% of attempts)",
+       st->num_commits, st->num_aborts, attempts ? 100.0 * st->num_aborts / attempts : 0.0);
+}
+
+static const sim_policy_t optimistic_policy = {
+  .name = "optimistic",
+  .window = 1,
+  .max_bypass = 0,
+  .create = optimistic_create,
+  .destroy = optimistic_destroy,
+  .admit = optimistic_admit,
+  .on_schedule = optimistic_on_schedule,
+  .on_complete = optimistic_on_complete,
+  .validate = optimistic_validate,
+  .report = optimistic_report,
+};
+
+/*
+Registry
+*/
+static const sim_policy_t *const policies[] = {
+  &exact_policy,
+  &lookahead_policy,
+  &bloom_policy,
+  &counting_policy,
+  &coloring_policy,
+  &tournament_policy,
+  &optimistic_policy,
+};
+
+const sim_policy_t *sim_policy_find(const char *name) {
+  for (int i = 0; i < (int)(sizeof(policies) / sizeof(policies[0])); ++i) {
+    if (strcmp(policies[i]->name, name) == 0) return policies[i];
+  }
+  return NULL;
+}
+
+const char *sim_policy_names() {
+  return "exact, lookahead, bloom, counting, coloring, tournament, optimistic";
+}